@@ -0,0 +1,103 @@
+/*
+ *    (c) Copyright 2026  Uwe Steinmann.
+ *    All rights reserved.
+ *
+ *    This library is free software; you can redistribute it and/or
+ *    modify it under the terms of the GNU Lesser General Public
+ *    License as published by the Free Software Foundation; either
+ *    version 2 of the License, or (at your option) any later version.
+ *
+ *    This library is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *    Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with this library; if not, write to the
+ *    Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *    Boston, MA 02111-1307, USA.
+ */
+
+/* Measures how many bytes of image data per second are encoded when
+ * an image is placed. The document is written into memory and thrown
+ * away, so only the encoding is timed.
+ *
+ * Usage: imagebench [encoding] [iterations]
+ *
+ * encoding is any value of the parameter 'imageencoding', the default
+ * is 'hex'.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <libps/pslib.h>
+
+#define BENCH_WIDTH 2048
+#define BENCH_HEIGHT 2048
+
+static size_t outlen = 0;
+
+static size_t
+countproc(PSDoc *p, void *data, size_t size) {
+	(void) p;
+	(void) data;
+	outlen += size;
+	return(size);
+}
+
+int main(int argc, char *argv[]) {
+	PSDoc *ps;
+	const char *encoding = "hex";
+	char *data;
+	size_t len = BENCH_WIDTH * BENCH_HEIGHT, i;
+	int iterations = 10, n, image;
+	clock_t start;
+	double secs;
+
+	if(argc > 1)
+		encoding = argv[1];
+	if(argc > 2)
+		iterations = atoi(argv[2]);
+	if(iterations < 1)
+		iterations = 1;
+
+	/* Random data is the worst case for the compressing encodings */
+	if(NULL == (data = malloc(len))) {
+		fprintf(stderr, "Could not allocate image data.\n");
+		return(1);
+	}
+	srand(7);
+	for(i = 0; i < len; i++)
+		data[i] = (char) rand();
+
+	PS_boot();
+	ps = PS_new();
+	PS_open_mem(ps, countproc);
+	PS_set_parameter(ps, "imageencoding", encoding);
+	PS_set_parameter(ps, "imagereuse", "false");
+
+	PS_begin_page(ps, 596, 842);
+	image = PS_open_image(ps, "memory", "memory", data, len, BENCH_WIDTH, BENCH_HEIGHT, 1, 8, NULL);
+	if(image == 0) {
+		fprintf(stderr, "Could not open image.\n");
+		return(1);
+	}
+	start = clock();
+	for(n = 0; n < iterations; n++) {
+		PS_place_image(ps, image, 0, 0, 0.25);
+		PS_flush(ps);
+	}
+	secs = (double) (clock() - start) / CLOCKS_PER_SEC;
+	PS_close_image(ps, image);
+	PS_end_page(ps);
+	PS_close(ps);
+	PS_delete(ps);
+	PS_shutdown();
+	free(data);
+
+	printf("%s: %lu bytes in, %lu bytes out, %.2f s, %.1f MB/s\n",
+	       encoding, (unsigned long) (len * iterations), (unsigned long) outlen,
+	       secs, secs > 0.0 ? (double) len * iterations / 1e6 / secs : 0.0);
+	return(0);
+}
@@ -52,6 +52,58 @@ typedef int ps_bool;
 
 typedef struct PSDoc_ PSDoc;
 
+/* A piece of a document created in memory, see PS_get_buffer_chunks() */
+typedef struct PSBufferChunk_ {
+	const char *data;
+	size_t size;
+} PSBufferChunk;
+
+/* Categories of output counted in PSStats.bytes[] */
+#define PS_STATS_OTHER 0
+#define PS_STATS_COMMENT 1
+#define PS_STATS_PROLOG 2
+#define PS_STATS_TEXT 3
+#define PS_STATS_PATH 4
+#define PS_STATS_IMAGE 5
+#define PS_STATS_FONT 6
+#define PS_STATS_CATEGORIES 7
+
+/* Timers in PSStats.time[] */
+#define PS_STATS_TIME_IMAGE 0
+#define PS_STATS_TIME_FONT 1
+#define PS_STATS_TIME_TEXT 2
+#define PS_STATS_TIMERS 3
+
+/* Statistics of a document, see PS_get_stats() */
+typedef struct PSStats_ {
+	unsigned long long size;       /* Number of bytes of the document */
+	unsigned long long bytes[PS_STATS_CATEGORIES]; /* ... per category */
+	unsigned long long outbytes;   /* Bytes passed to the write procedure */
+	unsigned long writecalls;      /* Number of calls of the write procedure */
+	int pages;                     /* Number of pages */
+	double time[PS_STATS_TIMERS];  /* Seconds spent in image encoding,
+	                                  font loading and text layout */
+} PSStats;
+
+/* Statistics of a page, see PS_get_page_stats() */
+typedef struct PSPageStats_ {
+	unsigned long long offset;     /* Position of the page in the document */
+	unsigned long long size;       /* Number of bytes of the page */
+} PSPageStats;
+
+/* Maximum size of a checksum returned by PS_get_digest() */
+#define PS_DIGEST_MAXSIZE 32
+
+/* Positions of the sections of a document, see PS_get_index().
+ * A position of 0 means the section has not been written yet. */
+typedef struct PSDocIndex_ {
+	unsigned long long prolog;     /* %%BeginProlog */
+	unsigned long long setup;      /* %%BeginSetup */
+	unsigned long long trailer;    /* %%Trailer */
+	unsigned long long size;       /* Number of bytes of the document */
+	int pages;                     /* Number of pages */
+} PSDocIndex;
+
 PSLIB_API int PSLIB_CALL
 PS_get_majorversion(void);
 
@@ -263,6 +315,27 @@ PS_scale(PSDoc *psdoc, float x, float y);
 PSLIB_API const char * PSLIB_CALL
 PS_get_buffer(PSDoc *psdoc, long *size);
 
+PSLIB_API int PSLIB_CALL
+PS_get_buffer_chunks(PSDoc *psdoc, PSBufferChunk *chunks, int maxchunks);
+
+PSLIB_API int PSLIB_CALL
+PS_drain_buffer_chunks(PSDoc *psdoc, PSBufferChunk *chunks, int maxchunks);
+
+PSLIB_API void PSLIB_CALL
+PS_flush(PSDoc *psdoc);
+
+PSLIB_API int PSLIB_CALL
+PS_get_stats(PSDoc *psdoc, PSStats *stats);
+
+PSLIB_API int PSLIB_CALL
+PS_get_page_stats(PSDoc *psdoc, int page, PSPageStats *stats);
+
+PSLIB_API int PSLIB_CALL
+PS_get_index(PSDoc *psdoc, PSDocIndex *index);
+
+PSLIB_API int PSLIB_CALL
+PS_get_digest(PSDoc *psdoc, int page, unsigned char *digest);
+
 PSLIB_API int PSLIB_CALL
 PS_open_image(PSDoc *psdoc, const char *type, const char *source, const char *data, long length, int width, int height, int components, int bpc, const char *params);
 
@@ -275,6 +348,15 @@ PS_place_image(PSDoc *psdoc, int imageid, float x, float y, float scale);
 PSLIB_API void PSLIB_CALL
 PS_close_image(PSDoc *psdoc, int imageid);
 
+PSLIB_API int PSLIB_CALL
+PS_begin_image(PSDoc *psdoc, int width, int height, int components, int bpc);
+
+PSLIB_API void PSLIB_CALL
+PS_write_image_rows(PSDoc *psdoc, const char *data, int rows);
+
+PSLIB_API void PSLIB_CALL
+PS_end_image(PSDoc *psdoc);
+
 PSLIB_API void PSLIB_CALL
 PS_add_weblink(PSDoc *psdoc, float llx, float lly, float urx, float ury, const char *url);
 
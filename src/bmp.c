@@ -681,3 +681,91 @@ bad:
 
 	return data;
 }
+
+/*
+ * Reads the size of a bmp image and the bits per sample and samples per
+ * pixel of the data returned by read_bmp() without reading the data.
+ * Returns 0 on success.
+ */
+int read_bmp_header (PSDoc *psdoc, const char* file, int* w, int* h,
+		int* bps, int* spp) {
+	int fd;
+	char bType[2];
+	BMPInfoHeader info_hdr;
+
+	fd = open(file, O_RDONLY|O_BINARY, 0);
+	if (fd < 0) {
+		ps_error(psdoc, PS_RuntimeError, _("Could not open bmp file."));
+		return -1;
+	}
+
+	if (read(fd, bType, 2) != 2 || bType[0] != 'B' || bType[1] != 'M') {
+		ps_error(psdoc, PS_RuntimeError, _("File is not a bmp file."));
+		close(fd);
+		return -1;
+	}
+
+	lseek(fd, BFH_SIZE, SEEK_SET);
+	read(fd, &info_hdr.iSize, 4);
+#ifdef WORDS_BIGENDIAN
+	BMPSwabLong(&info_hdr.iSize);
+#endif
+
+	info_hdr.iCompression = BMPC_RGB;
+	if (info_hdr.iSize == BIH_OS21SIZE) {
+		int16 iShort;
+
+		read(fd, &iShort, 2);
+#ifdef WORDS_BIGENDIAN
+		BMPSwabShort(&iShort);
+#endif
+		info_hdr.iWidth = iShort;
+		read(fd, &iShort, 2);
+#ifdef WORDS_BIGENDIAN
+		BMPSwabShort(&iShort);
+#endif
+		info_hdr.iHeight = iShort;
+		read(fd, &info_hdr.iPlanes, 2);
+		read(fd, &info_hdr.iBitCount, 2);
+#ifdef WORDS_BIGENDIAN
+		BMPSwabShort(&info_hdr.iBitCount);
+#endif
+	} else {
+		read(fd, &info_hdr.iWidth, 4);
+		read(fd, &info_hdr.iHeight, 4);
+		read(fd, &info_hdr.iPlanes, 2);
+		read(fd, &info_hdr.iBitCount, 2);
+		read(fd, &info_hdr.iCompression, 4);
+#ifdef WORDS_BIGENDIAN
+		BMPSwabLong(&info_hdr.iWidth);
+		BMPSwabLong(&info_hdr.iHeight);
+		BMPSwabShort(&info_hdr.iBitCount);
+		BMPSwabLong(&info_hdr.iCompression);
+#endif
+	}
+	close(fd);
+
+	if (info_hdr.iBitCount != 1  && info_hdr.iBitCount != 4  &&
+	    info_hdr.iBitCount != 8  && info_hdr.iBitCount != 16 &&
+	    info_hdr.iBitCount != 24 && info_hdr.iBitCount != 32) {
+		ps_error(psdoc, PS_RuntimeError, _("Cannot process bmp file with bit count %d."), info_hdr.iBitCount);
+		return -1;
+	}
+
+	*w = info_hdr.iWidth;
+	*h = (info_hdr.iHeight > 0) ? info_hdr.iHeight : -info_hdr.iHeight;
+	if (info_hdr.iBitCount <= 8) {
+		*spp = 1;
+		/* read_bmp() expands run length encoded data to one byte per pixel */
+		if (info_hdr.iCompression == BMPC_RLE4 || info_hdr.iCompression == BMPC_RLE8)
+			*bps = 8;
+		else
+			*bps = info_hdr.iBitCount;
+	} else {
+		/* All other data is converted to 8 bit RGB */
+		*spp = 3;
+		*bps = 8;
+	}
+
+	return 0;
+}
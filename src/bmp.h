@@ -8,6 +8,8 @@ unsigned char* read_bmp (PSDoc *psdoc, const char* file, int* w,
 	int* h, int* bps, int* spp,
 	int* xres, int* yres, unsigned char** color_table,
 	int* color_table_size, int* color_table_elements);
+int read_bmp_header (PSDoc *psdoc, const char* file, int* w,
+	int* h, int* bps, int* spp);
 
 #ifdef __cplusplus
 }
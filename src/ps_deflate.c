@@ -0,0 +1,644 @@
+/*
+ *    (c) Copyright 2026  Uwe Steinmann.
+ *    All rights reserved.
+ *
+ *    This library is free software; you can redistribute it and/or
+ *    modify it under the terms of the GNU Lesser General Public
+ *    License as published by the Free Software Foundation; either
+ *    version 2 of the License, or (at your option) any later version.
+ *
+ *    This library is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *    Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with this library; if not, write to the
+ *    Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *    Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include "ps_intern.h"
+#include "ps_error.h"
+
+/* A deflater compresses data with zlib and passes the compressed data
+ * in blocks to a sink function together with the pointer passed to
+ * ps_deflater_new().
+ *
+ * Large amounts of data can be compressed by several threads like pigz
+ * does it. The data is split into chunks, which are compressed
+ * independently, each with the end of the previous chunk as dictionary.
+ * A chunk ends with a sync flush, so the compressed chunks put together
+ * in order form a single deflate stream. Only the checksum is computed
+ * per chunk and combined. The threads work on a ring of jobs. All
+ * memory is allocated by the calling thread, because the allocation
+ * functions of the document need not be thread safe.
+ */
+
+#ifdef HAVE_LIBZ
+
+/* Size of the chunks compressed in parallel */
+#define PS_DEFLATE_CHUNK (128*1024)
+/* Size of the dictionary taken from the previous chunk */
+#define PS_DEFLATE_DICT (32*1024)
+
+#ifdef HAVE_PTHREAD
+
+/* States of a job */
+#define PS_DEFLATE_JOB_FREE    0
+#define PS_DEFLATE_JOB_QUEUED  1
+#define PS_DEFLATE_JOB_RUNNING 2
+#define PS_DEFLATE_JOB_DONE    3
+
+typedef struct ps_deflate_job_ PSDEFLATEJOB;
+
+struct ps_deflate_job_ {
+	unsigned char *in;    /* Dictionary followed by the chunk */
+	size_t dictlen;
+	size_t inlen;         /* Number of bytes of the chunk */
+	unsigned char *out;
+	size_t outsize;
+	size_t outlen;
+	unsigned long check;  /* adler32 or crc32 of the chunk */
+	int last;             /* Set for the chunk terminating the stream */
+	int state;
+	int error;
+};
+
+#endif
+
+struct ps_deflater_ {
+	z_stream stream;
+	size_t (*sink)(PSDoc *p, void *sinkdata, const void *data, size_t size);
+	void *sinkdata;
+	unsigned char *out;
+	size_t outsize;
+	int level;
+	int format;
+	int error;
+#ifdef HAVE_PTHREAD
+	int nthreads;           /* Number of threads, 0 if compressed serially */
+	int created;            /* Number of threads created */
+	int nextstream;         /* Stream taken by the next thread starting */
+	int submitted;          /* Set once a chunk has been passed to the threads */
+	int finish;             /* Set if the threads shall terminate */
+	pthread_t *threads;
+	z_stream *streams;      /* One raw stream for each thread */
+	pthread_mutex_t mutex;
+	pthread_cond_t queued;  /* Signaled when a job was queued */
+	pthread_cond_t done;    /* Signaled when a job was done */
+	PSDEFLATEJOB *jobs;
+	int njobs;
+	int head;               /* Oldest job not passed to the sink yet */
+	int fill;               /* Job being filled with data */
+	int next;               /* Next job to be taken by a thread */
+	int pending;            /* Number of jobs between head and fill */
+	unsigned long check;    /* Checksum of the chunks passed to the sink */
+	unsigned long total;    /* Number of bytes of those chunks */
+#endif
+};
+
+/* ps_deflater_zalloc() {{{
+ * Memory allocation for zlib using the allocation function of the document
+ */
+static voidpf ps_deflater_zalloc(voidpf opaque, uInt items, uInt size) {
+	PSDoc *psdoc = opaque;
+	return(psdoc->malloc(psdoc, (size_t) items * size, _("Allocate memory for zlib")));
+}
+/* }}} */
+
+/* ps_deflater_zfree() {{{
+ */
+static void ps_deflater_zfree(voidpf opaque, voidpf address) {
+	PSDoc *psdoc = opaque;
+	psdoc->free(psdoc, address);
+}
+/* }}} */
+
+/* ps_deflater_new() {{{
+ * Creates a new deflater. level is the compression level between 0
+ * and 9 or -1 for the default level of zlib.
+ */
+PSDEFLATER *ps_deflater_new(PSDoc *psdoc, int level, int format, size_t (*sink)(PSDoc *p, void *sinkdata, const void *data, size_t size), void *sinkdata) {
+	PSDEFLATER *d;
+	int windowbits;
+
+	if(level < -1 || level > 9) {
+		ps_error(psdoc, PS_Warning, _("Compression level must be between 0 and 9. Using default level."));
+		level = Z_DEFAULT_COMPRESSION;
+	}
+	switch(format) {
+		case PS_DEFLATE_RAW:
+			windowbits = -MAX_WBITS;
+			break;
+		case PS_DEFLATE_GZIP:
+			windowbits = MAX_WBITS + 16;
+			break;
+		default:
+			windowbits = MAX_WBITS;
+	}
+
+	if(NULL == (d = psdoc->malloc(psdoc, sizeof(PSDEFLATER), _("Allocate memory for deflater"))))
+		return NULL;
+	memset(d, 0, sizeof(PSDEFLATER));
+	d->sink = sink;
+	d->sinkdata = sinkdata;
+	d->level = level;
+	d->format = format;
+	d->outsize = PS_OUTPUT_BUFFER_SIZE;
+	if(NULL == (d->out = psdoc->malloc(psdoc, d->outsize, _("Allocate memory for deflater")))) {
+		psdoc->free(psdoc, d);
+		return NULL;
+	}
+	d->stream.zalloc = ps_deflater_zalloc;
+	d->stream.zfree = ps_deflater_zfree;
+	d->stream.opaque = psdoc;
+	if(Z_OK != deflateInit2(&d->stream, level, Z_DEFLATED, windowbits, 8, Z_DEFAULT_STRATEGY)) {
+		ps_error(psdoc, PS_RuntimeError, _("Could not initialize zlib."));
+		psdoc->free(psdoc, d->out);
+		psdoc->free(psdoc, d);
+		return NULL;
+	}
+	d->stream.next_out = d->out;
+	d->stream.avail_out = d->outsize;
+	return(d);
+}
+/* }}} */
+
+/* ps_deflater_run() {{{
+ * Compresses the pending input and passes each full output block to the
+ * sink. If mode is not Z_NO_FLUSH, all output is passed to the sink.
+ */
+static int ps_deflater_run(PSDoc *psdoc, PSDEFLATER *d, int mode) {
+	int ret;
+
+	if(d->error)
+		return(-1);
+	for(;;) {
+		ret = deflate(&d->stream, mode);
+		if(ret == Z_STREAM_ERROR) {
+			ps_error(psdoc, PS_RuntimeError, _("Compression of data failed."));
+			d->error = 1;
+			return(-1);
+		}
+		if(d->stream.avail_out == 0 || (mode != Z_NO_FLUSH && d->stream.next_out != d->out)) {
+			d->sink(psdoc, d->sinkdata, d->out, d->stream.next_out - d->out);
+			d->stream.next_out = d->out;
+			d->stream.avail_out = d->outsize;
+			continue;
+		}
+		/* The output buffer was not filled, so all input has been
+		 * consumed and everything requested by mode has been done */
+		if(mode != Z_FINISH || ret == Z_STREAM_END)
+			break;
+	}
+	return(0);
+}
+/* }}} */
+
+#ifdef HAVE_PTHREAD
+
+/* ps_deflater_run_job() {{{
+ * Compresses a chunk with the given raw stream. This is called by the
+ * threads and must not use the document.
+ */
+static void ps_deflater_run_job(PSDEFLATER *d, PSDEFLATEJOB *job, z_stream *stream) {
+	int ret;
+
+	job->error = 0;
+	if(Z_OK != deflateReset(stream) ||
+	   (job->dictlen > 0 && Z_OK != deflateSetDictionary(stream, job->in, job->dictlen))) {
+		job->error = 1;
+		return;
+	}
+	stream->next_in = job->in + job->dictlen;
+	stream->avail_in = job->inlen;
+	stream->next_out = job->out;
+	stream->avail_out = job->outsize;
+	ret = deflate(stream, job->last ? Z_FINISH : Z_SYNC_FLUSH);
+	/* The output buffer is large enough for the whole chunk */
+	if(job->last ? ret != Z_STREAM_END : (ret != Z_OK || stream->avail_out == 0))
+		job->error = 1;
+	job->outlen = job->outsize - stream->avail_out;
+	if(d->format == PS_DEFLATE_GZIP)
+		job->check = crc32(crc32(0L, Z_NULL, 0), job->in + job->dictlen, job->inlen);
+	else
+		job->check = adler32(adler32(0L, Z_NULL, 0), job->in + job->dictlen, job->inlen);
+}
+/* }}} */
+
+/* ps_deflater_thread() {{{
+ * Main loop of a compressing thread
+ */
+static void *ps_deflater_thread(void *data) {
+	PSDEFLATER *d = data;
+	PSDEFLATEJOB *job;
+	int i;
+
+	pthread_mutex_lock(&d->mutex);
+	/* Each thread owns a stream */
+	i = d->nextstream++;
+	for(;;) {
+		while(!d->finish && d->jobs[d->next].state != PS_DEFLATE_JOB_QUEUED)
+			pthread_cond_wait(&d->queued, &d->mutex);
+		if(d->finish)
+			break;
+		job = &d->jobs[d->next];
+		job->state = PS_DEFLATE_JOB_RUNNING;
+		d->next = (d->next + 1) % d->njobs;
+		pthread_mutex_unlock(&d->mutex);
+
+		ps_deflater_run_job(d, job, &d->streams[i]);
+
+		pthread_mutex_lock(&d->mutex);
+		job->state = PS_DEFLATE_JOB_DONE;
+		pthread_cond_broadcast(&d->done);
+	}
+	pthread_mutex_unlock(&d->mutex);
+	return(NULL);
+}
+/* }}} */
+
+/* ps_deflater_stop() {{{
+ * Terminates the threads and frees the memory for parallel compression
+ */
+static void ps_deflater_stop(PSDoc *psdoc, PSDEFLATER *d) {
+	int i;
+
+	if(d->nthreads == 0)
+		return;
+	pthread_mutex_lock(&d->mutex);
+	d->finish = 1;
+	pthread_cond_broadcast(&d->queued);
+	pthread_mutex_unlock(&d->mutex);
+	if(d->threads) {
+		for(i = 0; i < d->created; i++)
+			pthread_join(d->threads[i], NULL);
+		psdoc->free(psdoc, d->threads);
+		d->threads = NULL;
+	}
+	for(i = 0; i < d->nthreads; i++)
+		if(d->streams[i].state)
+			deflateEnd(&d->streams[i]);
+	psdoc->free(psdoc, d->streams);
+	for(i = 0; i < d->njobs; i++) {
+		if(d->jobs[i].in)
+			psdoc->free(psdoc, d->jobs[i].in);
+		if(d->jobs[i].out)
+			psdoc->free(psdoc, d->jobs[i].out);
+	}
+	psdoc->free(psdoc, d->jobs);
+	pthread_mutex_destroy(&d->mutex);
+	pthread_cond_destroy(&d->queued);
+	pthread_cond_destroy(&d->done);
+	d->nthreads = 0;
+}
+/* }}} */
+
+/* ps_deflater_output_jobs() {{{
+ * Passes compressed chunks to the sink in order. If all is set, it
+ * waits for all chunks passed to the threads, otherwise finished chunks
+ * are passed on and it only waits while no job is free.
+ */
+static int ps_deflater_output_jobs(PSDoc *psdoc, PSDEFLATER *d, int all) {
+	PSDEFLATEJOB *job;
+	int done;
+
+	while(d->pending > 0) {
+		job = &d->jobs[d->head];
+		pthread_mutex_lock(&d->mutex);
+		while(job->state != PS_DEFLATE_JOB_DONE && (all || d->pending == d->njobs - 1))
+			pthread_cond_wait(&d->done, &d->mutex);
+		done = job->state == PS_DEFLATE_JOB_DONE;
+		pthread_mutex_unlock(&d->mutex);
+		if(!done)
+			break;
+		if(job->error && !d->error) {
+			ps_error(psdoc, PS_RuntimeError, _("Compression of data failed."));
+			d->error = 1;
+		}
+		if(!d->error)
+			d->sink(psdoc, d->sinkdata, job->out, job->outlen);
+		if(d->format == PS_DEFLATE_GZIP)
+			d->check = crc32_combine(d->check, job->check, job->inlen);
+		else
+			d->check = adler32_combine(d->check, job->check, job->inlen);
+		d->total += job->inlen;
+		job->state = PS_DEFLATE_JOB_FREE;
+		d->head = (d->head + 1) % d->njobs;
+		d->pending--;
+	}
+	return(d->error ? -1 : 0);
+}
+/* }}} */
+
+/* ps_deflater_start() {{{
+ * Starts the threads and outputs the header of the stream before the
+ * first chunk is passed to them. If no thread can be started, chunks
+ * are compressed by the calling thread.
+ */
+static void ps_deflater_start(PSDoc *psdoc, PSDEFLATER *d) {
+	unsigned char header[10];
+	unsigned int h;
+	int levelflags;
+
+	switch(d->format) {
+		case PS_DEFLATE_ZLIB:
+			/* Compression method 8 with a 32K window, the level flags and
+			 * a check value making the header a multiple of 31, just as
+			 * zlib writes it */
+			if(d->level >= 0 && d->level < 2)
+				levelflags = 0;
+			else if(d->level >= 2 && d->level < 6)
+				levelflags = 1;
+			else if(d->level == 6 || d->level == -1)
+				levelflags = 2;
+			else
+				levelflags = 3;
+			h = (0x78 << 8) | (levelflags << 6);
+			h += 31 - (h % 31);
+			header[0] = h >> 8;
+			header[1] = h & 0xff;
+			d->sink(psdoc, d->sinkdata, header, 2);
+			break;
+		case PS_DEFLATE_GZIP:
+			memset(header, 0, sizeof(header));
+			header[0] = 0x1f;
+			header[1] = 0x8b;
+			header[2] = 8;
+			header[9] = 3; /* Unix */
+			d->sink(psdoc, d->sinkdata, header, 10);
+			break;
+	}
+	d->check = d->format == PS_DEFLATE_GZIP ? crc32(0L, Z_NULL, 0) : adler32(0L, Z_NULL, 0);
+	d->total = 0;
+	d->submitted = 1;
+
+	if(NULL == (d->threads = psdoc->malloc(psdoc, d->nthreads * sizeof(pthread_t), _("Allocate memory for compressing threads"))))
+		return;
+	for(d->created = 0; d->created < d->nthreads; d->created++)
+		if(0 != pthread_create(&d->threads[d->created], NULL, ps_deflater_thread, d))
+			break;
+	if(d->created == 0) {
+		psdoc->free(psdoc, d->threads);
+		d->threads = NULL;
+	}
+}
+/* }}} */
+
+/* ps_deflater_submit() {{{
+ * Passes the job being filled to the threads and prepares the next one
+ * with the end of the submitted chunk as dictionary
+ */
+static int ps_deflater_submit(PSDoc *psdoc, PSDEFLATER *d, int last) {
+	PSDEFLATEJOB *job, *nextjob;
+	size_t dictlen;
+
+	if(!d->submitted)
+		ps_deflater_start(psdoc, d);
+	job = &d->jobs[d->fill];
+	job->last = last;
+	if(d->threads) {
+		pthread_mutex_lock(&d->mutex);
+		job->state = PS_DEFLATE_JOB_QUEUED;
+		pthread_cond_signal(&d->queued);
+		pthread_mutex_unlock(&d->mutex);
+	} else {
+		ps_deflater_run_job(d, job, &d->streams[0]);
+		job->state = PS_DEFLATE_JOB_DONE;
+	}
+	d->fill = (d->fill + 1) % d->njobs;
+	d->pending++;
+
+	/* Pass finished chunks on and wait for a free job */
+	if(0 != ps_deflater_output_jobs(psdoc, d, 0))
+		return(-1);
+
+	if(!last) {
+		nextjob = &d->jobs[d->fill];
+		dictlen = job->dictlen + job->inlen;
+		if(dictlen > PS_DEFLATE_DICT)
+			dictlen = PS_DEFLATE_DICT;
+		memcpy(nextjob->in, job->in + job->dictlen + job->inlen - dictlen, dictlen);
+		nextjob->dictlen = dictlen;
+		nextjob->inlen = 0;
+	}
+	return(0);
+}
+/* }}} */
+
+/* ps_deflater_serial() {{{
+ * Gives up parallel compression before any chunk has been passed to the
+ * threads and compresses the collected data serially
+ */
+static int ps_deflater_serial(PSDoc *psdoc, PSDEFLATER *d) {
+	PSDEFLATEJOB *job = &d->jobs[d->fill];
+	int ret;
+
+	d->stream.next_in = job->in + job->dictlen;
+	d->stream.avail_in = job->inlen;
+	ret = ps_deflater_run(psdoc, d, Z_NO_FLUSH);
+	ps_deflater_stop(psdoc, d);
+	return(ret);
+}
+/* }}} */
+
+#endif /* HAVE_PTHREAD */
+
+/* ps_deflater_set_threads() {{{
+ * Lets up to threads threads compress the data. This must be called
+ * before any data is written. Data smaller than a chunk is still
+ * compressed serially, which gives the same result as without threads.
+ */
+void ps_deflater_set_threads(PSDoc *psdoc, PSDEFLATER *d, int threads) {
+#ifdef HAVE_PTHREAD
+	int i;
+
+	if(threads < 2 || d->nthreads > 0)
+		return;
+	d->njobs = 2 * threads + 1;
+	if(NULL == (d->jobs = psdoc->malloc(psdoc, d->njobs * sizeof(PSDEFLATEJOB), _("Allocate memory for compressing threads"))))
+		return;
+	memset(d->jobs, 0, d->njobs * sizeof(PSDEFLATEJOB));
+	if(NULL == (d->streams = psdoc->malloc(psdoc, threads * sizeof(z_stream), _("Allocate memory for compressing threads")))) {
+		psdoc->free(psdoc, d->jobs);
+		return;
+	}
+	memset(d->streams, 0, threads * sizeof(z_stream));
+	pthread_mutex_init(&d->mutex, NULL);
+	pthread_cond_init(&d->queued, NULL);
+	pthread_cond_init(&d->done, NULL);
+	d->nthreads = threads;
+	for(i = 0; i < threads; i++) {
+		d->streams[i].zalloc = ps_deflater_zalloc;
+		d->streams[i].zfree = ps_deflater_zfree;
+		d->streams[i].opaque = psdoc;
+		if(Z_OK != deflateInit2(&d->streams[i], d->level, Z_DEFLATED, -MAX_WBITS, 8, Z_DEFAULT_STRATEGY)) {
+			d->streams[i].state = NULL;
+			ps_deflater_stop(psdoc, d);
+			return;
+		}
+	}
+	for(i = 0; i < d->njobs; i++) {
+		d->jobs[i].outsize = deflateBound(&d->streams[0], PS_DEFLATE_CHUNK) + 16;
+		if(NULL == (d->jobs[i].in = psdoc->malloc(psdoc, PS_DEFLATE_DICT + PS_DEFLATE_CHUNK, _("Allocate memory for compressing threads"))) ||
+		   NULL == (d->jobs[i].out = psdoc->malloc(psdoc, d->jobs[i].outsize, _("Allocate memory for compressing threads")))) {
+			ps_deflater_stop(psdoc, d);
+			return;
+		}
+	}
+#else
+	(void) psdoc;
+	(void) d;
+	(void) threads;
+#endif
+}
+/* }}} */
+
+/* ps_deflater_write() {{{
+ * Compresses data
+ */
+int ps_deflater_write(PSDoc *psdoc, PSDEFLATER *d, const void *data, size_t size) {
+#ifdef HAVE_PTHREAD
+	if(d->nthreads > 0) {
+		PSDEFLATEJOB *job;
+		size_t n;
+
+		while(size > 0) {
+			job = &d->jobs[d->fill];
+			if(job->inlen == PS_DEFLATE_CHUNK && 0 != ps_deflater_submit(psdoc, d, 0))
+				return(-1);
+			job = &d->jobs[d->fill];
+			n = PS_DEFLATE_CHUNK - job->inlen;
+			if(n > size)
+				n = size;
+			memcpy(job->in + job->dictlen + job->inlen, data, n);
+			job->inlen += n;
+			data = (const char *) data + n;
+			size -= n;
+		}
+		return(d->error ? -1 : 0);
+	}
+#endif
+	d->stream.next_in = (Bytef *) data;
+	d->stream.avail_in = size;
+	return(ps_deflater_run(psdoc, d, Z_NO_FLUSH));
+}
+/* }}} */
+
+/* ps_deflater_flush() {{{
+ * Passes all data compressed so far to the sink. The compressed stream
+ * is not terminated.
+ */
+int ps_deflater_flush(PSDoc *psdoc, PSDEFLATER *d) {
+#ifdef HAVE_PTHREAD
+	if(d->nthreads > 0) {
+		if(!d->submitted) {
+			if(0 != ps_deflater_serial(psdoc, d))
+				return(-1);
+		} else {
+			if(0 != ps_deflater_submit(psdoc, d, 0))
+				return(-1);
+			return(ps_deflater_output_jobs(psdoc, d, 1));
+		}
+	}
+#endif
+	d->stream.avail_in = 0;
+	return(ps_deflater_run(psdoc, d, Z_SYNC_FLUSH));
+}
+/* }}} */
+
+/* ps_deflater_finish() {{{
+ * Terminates the compressed stream and passes the rest to the sink
+ */
+int ps_deflater_finish(PSDoc *psdoc, PSDEFLATER *d) {
+#ifdef HAVE_PTHREAD
+	if(d->nthreads > 0) {
+		unsigned char trailer[8];
+
+		if(!d->submitted) {
+			if(0 != ps_deflater_serial(psdoc, d))
+				return(-1);
+		} else {
+			if(0 != ps_deflater_submit(psdoc, d, 1) || 0 != ps_deflater_output_jobs(psdoc, d, 1))
+				return(-1);
+			switch(d->format) {
+				case PS_DEFLATE_ZLIB:
+					trailer[0] = (d->check >> 24) & 0xff;
+					trailer[1] = (d->check >> 16) & 0xff;
+					trailer[2] = (d->check >> 8) & 0xff;
+					trailer[3] = d->check & 0xff;
+					d->sink(psdoc, d->sinkdata, trailer, 4);
+					break;
+				case PS_DEFLATE_GZIP:
+					trailer[0] = d->check & 0xff;
+					trailer[1] = (d->check >> 8) & 0xff;
+					trailer[2] = (d->check >> 16) & 0xff;
+					trailer[3] = (d->check >> 24) & 0xff;
+					trailer[4] = d->total & 0xff;
+					trailer[5] = (d->total >> 8) & 0xff;
+					trailer[6] = (d->total >> 16) & 0xff;
+					trailer[7] = (d->total >> 24) & 0xff;
+					d->sink(psdoc, d->sinkdata, trailer, 8);
+					break;
+			}
+			return(0);
+		}
+	}
+#endif
+	d->stream.avail_in = 0;
+	return(ps_deflater_run(psdoc, d, Z_FINISH));
+}
+/* }}} */
+
+/* ps_deflater_delete() {{{
+ * Frees the deflater. Any data not passed to the sink yet is lost.
+ */
+void ps_deflater_delete(PSDoc *psdoc, PSDEFLATER *d) {
+#ifdef HAVE_PTHREAD
+	ps_deflater_stop(psdoc, d);
+#endif
+	deflateEnd(&d->stream);
+	psdoc->free(psdoc, d->out);
+	psdoc->free(psdoc, d);
+}
+/* }}} */
+
+#else
+
+/* Without zlib no data can be compressed */
+
+PSDEFLATER *ps_deflater_new(PSDoc *psdoc, int level, int format, size_t (*sink)(PSDoc *p, void *sinkdata, const void *data, size_t size), void *sinkdata) {
+	ps_error(psdoc, PS_RuntimeError, _("pslib was compiled without zlib. Data cannot be compressed."));
+	return NULL;
+}
+
+int ps_deflater_write(PSDoc *psdoc, PSDEFLATER *d, const void *data, size_t size) {
+	return(-1);
+}
+
+int ps_deflater_flush(PSDoc *psdoc, PSDEFLATER *d) {
+	return(-1);
+}
+
+int ps_deflater_finish(PSDoc *psdoc, PSDEFLATER *d) {
+	return(-1);
+}
+
+void ps_deflater_set_threads(PSDoc *psdoc, PSDEFLATER *d, int threads) {
+}
+
+void ps_deflater_delete(PSDoc *psdoc, PSDEFLATER *d) {
+}
+
+#endif /* HAVE_LIBZ */
+
@@ -0,0 +1,41 @@
+/*
+ *    (c) Copyright 2026  Uwe Steinmann.
+ *    All rights reserved.
+ *
+ *    This library is free software; you can redistribute it and/or
+ *    modify it under the terms of the GNU Lesser General Public
+ *    License as published by the Free Software Foundation; either
+ *    version 2 of the License, or (at your option) any later version.
+ *
+ *    This library is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *    Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with this library; if not, write to the
+ *    Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *    Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __PS_DEFLATE_H__
+#define __PS_DEFLATE_H__
+
+/* Formats of the compressed data */
+#define PS_DEFLATE_RAW  0
+#define PS_DEFLATE_ZLIB 1
+#define PS_DEFLATE_GZIP 2
+
+/* Upper limit of the number of compressing threads */
+#define PS_DEFLATE_MAXTHREADS 64
+
+typedef struct ps_deflater_ PSDEFLATER;
+
+PSDEFLATER *ps_deflater_new(PSDoc *psdoc, int level, int format, size_t (*sink)(PSDoc *p, void *sinkdata, const void *data, size_t size), void *sinkdata);
+void ps_deflater_set_threads(PSDoc *psdoc, PSDEFLATER *d, int threads);
+int ps_deflater_write(PSDoc *psdoc, PSDEFLATER *d, const void *data, size_t size);
+int ps_deflater_flush(PSDoc *psdoc, PSDEFLATER *d);
+int ps_deflater_finish(PSDoc *psdoc, PSDEFLATER *d);
+void ps_deflater_delete(PSDoc *psdoc, PSDEFLATER *d);
+
+#endif
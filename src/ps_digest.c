@@ -0,0 +1,237 @@
+/*
+ *    (c) Copyright 2026  Uwe Steinmann.
+ *    All rights reserved.
+ *
+ *    This library is free software; you can redistribute it and/or
+ *    modify it under the terms of the GNU Lesser General Public
+ *    License as published by the Free Software Foundation; either
+ *    version 2 of the License, or (at your option) any later version.
+ *
+ *    This library is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *    Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with this library; if not, write to the
+ *    Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *    Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include "config.h"
+#ifdef HAVE_LIBZ
+#include <zlib.h>
+#endif
+#include "ps_intern.h"
+#include "ps_error.h"
+
+/* A digest computes a CRC32 or SHA-256 checksum of data passed to it
+ * in arbitrary pieces.
+ */
+
+struct ps_digest_ {
+	int type;
+	unsigned long crc;
+#ifndef HAVE_LIBZ
+	unsigned long crctable[256];
+#endif
+	unsigned long state[8];      /* SHA-256 */
+	unsigned long long length;
+	unsigned char block[64];
+	size_t blocklen;
+};
+
+static const unsigned long ps_sha256_k[64] = {
+	0x428a2f98, 0x71374491, 0xb5c0fbcf, 0xe9b5dba5, 0x3956c25b, 0x59f111f1, 0x923f82a4, 0xab1c5ed5,
+	0xd807aa98, 0x12835b01, 0x243185be, 0x550c7dc3, 0x72be5d74, 0x80deb1fe, 0x9bdc06a7, 0xc19bf174,
+	0xe49b69c1, 0xefbe4786, 0x0fc19dc6, 0x240ca1cc, 0x2de92c6f, 0x4a7484aa, 0x5cb0a9dc, 0x76f988da,
+	0x983e5152, 0xa831c66d, 0xb00327c8, 0xbf597fc7, 0xc6e00bf3, 0xd5a79147, 0x06ca6351, 0x14292967,
+	0x27b70a85, 0x2e1b2138, 0x4d2c6dfc, 0x53380d13, 0x650a7354, 0x766a0abb, 0x81c2c92e, 0x92722c85,
+	0xa2bfe8a1, 0xa81a664b, 0xc24b8b70, 0xc76c51a3, 0xd192e819, 0xd6990624, 0xf40e3585, 0x106aa070,
+	0x19a4c116, 0x1e376c08, 0x2748774c, 0x34b0bcb5, 0x391c0cb3, 0x4ed8aa4a, 0x5b9cca4f, 0x682e6ff3,
+	0x748f82ee, 0x78a5636f, 0x84c87814, 0x8cc70208, 0x90befffa, 0xa4506ceb, 0xbef9a3f7, 0xc67178f2
+};
+
+#define ROTR(x, n) ((((x) >> (n)) | ((x) << (32 - (n)))) & 0xffffffffUL)
+
+/* ps_sha256_block() {{{
+ * Processes one block of 64 bytes
+ */
+static void ps_sha256_block(unsigned long *state, const unsigned char *block) {
+	unsigned long w[64], a, b, c, d, e, f, g, h, t1, t2;
+	int i;
+
+	for(i=0; i<16; i++)
+		w[i] = ((unsigned long) block[4*i] << 24) | ((unsigned long) block[4*i+1] << 16) |
+		       ((unsigned long) block[4*i+2] << 8) | (unsigned long) block[4*i+3];
+	for(i=16; i<64; i++) {
+		t1 = ROTR(w[i-2], 17) ^ ROTR(w[i-2], 19) ^ (w[i-2] >> 10);
+		t2 = ROTR(w[i-15], 7) ^ ROTR(w[i-15], 18) ^ (w[i-15] >> 3);
+		w[i] = (t1 + w[i-7] + t2 + w[i-16]) & 0xffffffffUL;
+	}
+	a = state[0]; b = state[1]; c = state[2]; d = state[3];
+	e = state[4]; f = state[5]; g = state[6]; h = state[7];
+	for(i=0; i<64; i++) {
+		t1 = (h + (ROTR(e, 6) ^ ROTR(e, 11) ^ ROTR(e, 25)) + ((e & f) ^ (~e & g)) + ps_sha256_k[i] + w[i]) & 0xffffffffUL;
+		t2 = ((ROTR(a, 2) ^ ROTR(a, 13) ^ ROTR(a, 22)) + ((a & b) ^ (a & c) ^ (b & c))) & 0xffffffffUL;
+		h = g; g = f; f = e;
+		e = (d + t1) & 0xffffffffUL;
+		d = c; c = b; b = a;
+		a = (t1 + t2) & 0xffffffffUL;
+	}
+	state[0] = (state[0] + a) & 0xffffffffUL;
+	state[1] = (state[1] + b) & 0xffffffffUL;
+	state[2] = (state[2] + c) & 0xffffffffUL;
+	state[3] = (state[3] + d) & 0xffffffffUL;
+	state[4] = (state[4] + e) & 0xffffffffUL;
+	state[5] = (state[5] + f) & 0xffffffffUL;
+	state[6] = (state[6] + g) & 0xffffffffUL;
+	state[7] = (state[7] + h) & 0xffffffffUL;
+}
+/* }}} */
+
+/* ps_digest_new() {{{
+ * Creates a new digest of the given type
+ */
+PSDIGEST *ps_digest_new(PSDoc *psdoc, int type) {
+	PSDIGEST *d;
+
+	if(type != PS_DIGEST_CRC32 && type != PS_DIGEST_SHA256) {
+		ps_error(psdoc, PS_RuntimeError, _("Unknown type of digest."));
+		return NULL;
+	}
+	if(NULL == (d = psdoc->malloc(psdoc, sizeof(PSDIGEST), _("Allocate memory for digest"))))
+		return NULL;
+	memset(d, 0, sizeof(PSDIGEST));
+	d->type = type;
+#ifndef HAVE_LIBZ
+	if(type == PS_DIGEST_CRC32) {
+		unsigned long c;
+		int i, j;
+		for(i=0; i<256; i++) {
+			c = (unsigned long) i;
+			for(j=0; j<8; j++)
+				c = (c & 1) ? 0xedb88320UL ^ (c >> 1) : c >> 1;
+			d->crctable[i] = c;
+		}
+	}
+#endif
+	ps_digest_reset(d);
+	return(d);
+}
+/* }}} */
+
+/* ps_digest_reset() {{{
+ * Starts a new checksum
+ */
+void ps_digest_reset(PSDIGEST *d) {
+	d->crc = 0;
+	d->length = 0;
+	d->blocklen = 0;
+	d->state[0] = 0x6a09e667UL;
+	d->state[1] = 0xbb67ae85UL;
+	d->state[2] = 0x3c6ef372UL;
+	d->state[3] = 0xa54ff53aUL;
+	d->state[4] = 0x510e527fUL;
+	d->state[5] = 0x9b05688cUL;
+	d->state[6] = 0x1f83d9abUL;
+	d->state[7] = 0x5be0cd19UL;
+}
+/* }}} */
+
+/* ps_digest_update() {{{
+ * Adds data to the checksum
+ */
+void ps_digest_update(PSDIGEST *d, const void *data, size_t size) {
+	const unsigned char *ptr = data;
+	size_t n;
+
+	if(size == 0)
+		return;
+	if(d->type == PS_DIGEST_CRC32) {
+#ifdef HAVE_LIBZ
+		/* zlib takes at most 4GB at once */
+		while(size > 0) {
+			n = size > 0x40000000 ? 0x40000000 : size;
+			d->crc = crc32(d->crc, ptr, (uInt) n);
+			ptr += n;
+			size -= n;
+		}
+#else
+		unsigned long c = d->crc ^ 0xffffffffUL;
+		while(size--)
+			c = d->crctable[(c ^ *ptr++) & 0xff] ^ (c >> 8);
+		d->crc = c ^ 0xffffffffUL;
+#endif
+		return;
+	}
+
+	d->length += size;
+	if(d->blocklen > 0) {
+		n = 64 - d->blocklen;
+		if(n > size)
+			n = size;
+		memcpy(&d->block[d->blocklen], ptr, n);
+		d->blocklen += n;
+		ptr += n;
+		size -= n;
+		if(d->blocklen < 64)
+			return;
+		ps_sha256_block(d->state, d->block);
+		d->blocklen = 0;
+	}
+	while(size >= 64) {
+		ps_sha256_block(d->state, ptr);
+		ptr += 64;
+		size -= 64;
+	}
+	if(size > 0) {
+		memcpy(d->block, ptr, size);
+		d->blocklen = size;
+	}
+}
+/* }}} */
+
+/* ps_digest_final() {{{
+ * Stores the checksum of all data passed since the last reset into
+ * digest, which must have room for PS_DIGEST_MAXSIZE bytes, and
+ * resets the digest. Returns the number of bytes of the checksum.
+ */
+int ps_digest_final(PSDIGEST *d, unsigned char *digest) {
+	unsigned long long bits;
+	int i;
+
+	if(d->type == PS_DIGEST_CRC32) {
+		for(i=0; i<4; i++)
+			digest[i] = (unsigned char) (d->crc >> (24 - 8*i));
+		ps_digest_reset(d);
+		return(4);
+	}
+
+	bits = d->length * 8;
+	d->block[d->blocklen++] = 0x80;
+	if(d->blocklen > 56) {
+		memset(&d->block[d->blocklen], 0, 64 - d->blocklen);
+		ps_sha256_block(d->state, d->block);
+		d->blocklen = 0;
+	}
+	memset(&d->block[d->blocklen], 0, 56 - d->blocklen);
+	for(i=0; i<8; i++)
+		d->block[56+i] = (unsigned char) (bits >> (56 - 8*i));
+	ps_sha256_block(d->state, d->block);
+	for(i=0; i<32; i++)
+		digest[i] = (unsigned char) (d->state[i/4] >> (24 - 8*(i%4)));
+	ps_digest_reset(d);
+	return(32);
+}
+/* }}} */
+
+/* ps_digest_delete() {{{
+ * Frees the digest
+ */
+void ps_digest_delete(PSDoc *psdoc, PSDIGEST *d) {
+	psdoc->free(psdoc, d);
+}
+/* }}} */
@@ -0,0 +1,37 @@
+/*
+ *    (c) Copyright 2026  Uwe Steinmann.
+ *    All rights reserved.
+ *
+ *    This library is free software; you can redistribute it and/or
+ *    modify it under the terms of the GNU Lesser General Public
+ *    License as published by the Free Software Foundation; either
+ *    version 2 of the License, or (at your option) any later version.
+ *
+ *    This library is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *    Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with this library; if not, write to the
+ *    Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *    Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __PS_DIGEST_H__
+#define __PS_DIGEST_H__
+
+/* Algorithms for checksums of the output */
+#define PS_DIGEST_NONE   0
+#define PS_DIGEST_CRC32  1
+#define PS_DIGEST_SHA256 2
+
+typedef struct ps_digest_ PSDIGEST;
+
+PSDIGEST *ps_digest_new(PSDoc *psdoc, int type);
+void ps_digest_reset(PSDIGEST *d);
+void ps_digest_update(PSDIGEST *d, const void *data, size_t size);
+int ps_digest_final(PSDIGEST *d, unsigned char *digest);
+void ps_digest_delete(PSDoc *psdoc, PSDIGEST *d);
+
+#endif
@@ -0,0 +1,834 @@
+/*
+ *    (c) Copyright 2026  Uwe Steinmann.
+ *    All rights reserved.
+ *
+ *    This library is free software; you can redistribute it and/or
+ *    modify it under the terms of the GNU Lesser General Public
+ *    License as published by the Free Software Foundation; either
+ *    version 2 of the License, or (at your option) any later version.
+ *
+ *    This library is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *    Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with this library; if not, write to the
+ *    Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *    Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "config.h"
+#include "ps_intern.h"
+#include "ps_error.h"
+
+/* A filter encodes the data written into it and passes the result on
+ * to the next filter or, if it is the last one, into the output buffer
+ * of the document. Chains of filters are built backwards, starting with
+ * the filter writing into the document. Data flows through the chain in
+ * blocks, so no filter needs to hold all of it. Closing the first filter
+ * of a chain terminates the data of all filters, deleting it frees them.
+ * A chain can also output the PostScript filters which decode its data.
+ */
+
+/* Maximum number of filters in a chain */
+#define PS_FILTER_MAXCHAIN 8
+
+/* Special LZW codes. Codes start with 9 bits and grow up to 12 bits.
+ * The table is cleared before it needs longer codes. */
+#define PS_LZW_CLEAR     256
+#define PS_LZW_EOD       257
+#define PS_LZW_FIRSTCODE 258
+#define PS_LZW_MAXCODES  4096
+/* Size of the hash table of LZW strings, a prime larger than the number
+ * of codes */
+#define PS_LZW_HASHSIZE  5003
+
+struct ps_filter_ {
+	int type;
+	PSFILTER *next;
+	const char *decodename; /* PostScript filter decoding the output */
+	PSFILTER *parms;        /* Predictor whose parameters are needed for decoding */
+	int error;
+	/* ASCII85 */
+	unsigned char group[4];
+	size_t grouplen;
+	int cc;
+	/* ASCIIHex */
+	size_t bytesperline;
+	size_t column;
+	int eod;
+	/* Flate */
+	PSDEFLATER *deflater;
+	/* RunLength and predictor, bytes passed by SubFile */
+	unsigned char *buf;
+	size_t buflen;
+	/* SubFile */
+	size_t count;
+	/* Buffer */
+	STRBUFFER *sb;
+	/* LZW, the output is collected in buf */
+	int *keys;              /* prefix code and byte of each string */
+	unsigned short *codes;  /* code of the string in keys */
+	int prefix;             /* code of the pending string, -1 if none */
+	int nextcode;
+	int codebits;
+	unsigned long bits;
+	int nbits;
+	/* Predictor */
+	int predictor;
+	int colors;
+	int bpc;
+	int columns;
+	size_t rowbytes;
+	size_t bpp;
+	unsigned char *prev;
+	unsigned char *out;
+	unsigned char *cand;
+	unsigned char *best;
+};
+
+/* ps_filter_new() {{{
+ * Allocates a filter of the given type
+ */
+static PSFILTER *ps_filter_new(PSDoc *psdoc, int type, PSFILTER *next, const char *decodename) {
+	PSFILTER *f;
+
+	if(NULL == (f = psdoc->malloc(psdoc, sizeof(PSFILTER), _("Allocate memory for filter"))))
+		return NULL;
+	memset(f, 0, sizeof(PSFILTER));
+	f->type = type;
+	f->next = next;
+	f->decodename = decodename;
+	return(f);
+}
+/* }}} */
+
+/* ps_filter_pass() {{{
+ * Passes encoded data to the next filter or into the document
+ */
+static int ps_filter_pass(PSDoc *psdoc, PSFILTER *f, const void *data, size_t size) {
+	if(f->next)
+		return(ps_filter_write(psdoc, f->next, data, size));
+	ps_write(psdoc, data, size);
+	return(0);
+}
+/* }}} */
+
+/* ps_filter_ascii85_new() {{{
+ * Creates a filter encoding data in ASCII85. Like the ASCIIHex filter it
+ * always writes into the document and can only be the last filter of
+ * a chain.
+ */
+PSFILTER *ps_filter_ascii85_new(PSDoc *psdoc) {
+	return(ps_filter_new(psdoc, PS_FILTER_ASCII85, NULL, "ASCII85Decode"));
+}
+/* }}} */
+
+/* ps_filter_asciihex_new() {{{
+ * Creates a filter encoding data as hex digits in lines of bytesperline
+ * bytes. If eod is set, the end of data marker '>' is appended.
+ */
+PSFILTER *ps_filter_asciihex_new(PSDoc *psdoc, size_t bytesperline, int eod) {
+	PSFILTER *f;
+
+	if(NULL == (f = ps_filter_new(psdoc, PS_FILTER_ASCIIHEX, NULL, "ASCIIHexDecode")))
+		return NULL;
+	f->bytesperline = bytesperline;
+	f->eod = eod;
+	return(f);
+}
+/* }}} */
+
+/* ps_filter_flate_sink() {{{
+ * Sink of the deflater of a flate filter
+ */
+static size_t ps_filter_flate_sink(PSDoc *psdoc, void *sinkdata, const void *data, size_t size) {
+	ps_filter_pass(psdoc, (PSFILTER *) sinkdata, data, size);
+	return(size);
+}
+/* }}} */
+
+/* ps_filter_flate_new() {{{
+ * Creates a filter compressing data with zlib using up to threads
+ * threads
+ */
+PSFILTER *ps_filter_flate_new(PSDoc *psdoc, PSFILTER *next, int level, int threads) {
+	PSFILTER *f;
+
+	if(NULL == (f = ps_filter_new(psdoc, PS_FILTER_FLATE, next, "FlateDecode")))
+		return NULL;
+	if(NULL == (f->deflater = ps_deflater_new(psdoc, level, PS_DEFLATE_ZLIB, ps_filter_flate_sink, f))) {
+		psdoc->free(psdoc, f);
+		return NULL;
+	}
+	ps_deflater_set_threads(psdoc, f->deflater, threads);
+	return(f);
+}
+/* }}} */
+
+/* ps_filter_runlength_new() {{{
+ * Creates a filter run length encoding data
+ */
+PSFILTER *ps_filter_runlength_new(PSDoc *psdoc, PSFILTER *next) {
+	PSFILTER *f;
+
+	if(NULL == (f = ps_filter_new(psdoc, PS_FILTER_RUNLENGTH, next, "RunLengthDecode")))
+		return NULL;
+	/* A block of input followed by room for its encoded version */
+	if(NULL == (f->buf = psdoc->malloc(psdoc, 2*PS_FILTER_BLOCKSIZE + PS_FILTER_BLOCKSIZE/128 + 2, _("Allocate memory for filter")))) {
+		psdoc->free(psdoc, f);
+		return NULL;
+	}
+	return(f);
+}
+/* }}} */
+
+/* ps_filter_lzw_code() {{{
+ * Appends a code to the output of a LZW filter and passes on the output
+ * when a block is full
+ */
+static int ps_filter_lzw_code(PSDoc *psdoc, PSFILTER *f, int code) {
+	size_t len;
+
+	f->bits = (f->bits << f->codebits) | code;
+	f->nbits += f->codebits;
+	while(f->nbits >= 8) {
+		f->nbits -= 8;
+		f->buf[f->buflen++] = (f->bits >> f->nbits) & 0xff;
+	}
+	f->bits &= (1UL << f->nbits) - 1;
+	/* A code adds at most two bytes */
+	if(f->buflen >= PS_FILTER_BLOCKSIZE - 2) {
+		len = f->buflen;
+		f->buflen = 0;
+		return(ps_filter_pass(psdoc, f, f->buf, len));
+	}
+	return(0);
+}
+/* }}} */
+
+/* ps_filter_lzw_clear() {{{
+ * Outputs the clear table marker and empties the string table
+ */
+static int ps_filter_lzw_clear(PSDoc *psdoc, PSFILTER *f) {
+	int ret;
+
+	ret = ps_filter_lzw_code(psdoc, f, PS_LZW_CLEAR);
+	memset(f->keys, 0xff, PS_LZW_HASHSIZE * sizeof(int));
+	f->nextcode = PS_LZW_FIRSTCODE;
+	f->codebits = 9;
+	return(ret);
+}
+/* }}} */
+
+/* ps_filter_lzw_new() {{{
+ * Creates a filter compressing data with LZW as expected by the
+ * LZWDecode filter with its default parameters. Codes grow one code
+ * early, which is the only variant understood by Level 2 interpreters.
+ */
+PSFILTER *ps_filter_lzw_new(PSDoc *psdoc, PSFILTER *next) {
+	PSFILTER *f;
+
+	if(NULL == (f = ps_filter_new(psdoc, PS_FILTER_LZW, next, "LZWDecode")))
+		return NULL;
+	/* A block of output followed by the hash table */
+	if(NULL == (f->buf = psdoc->malloc(psdoc, PS_FILTER_BLOCKSIZE + PS_LZW_HASHSIZE * (sizeof(int) + sizeof(unsigned short)), _("Allocate memory for filter")))) {
+		psdoc->free(psdoc, f);
+		return NULL;
+	}
+	f->keys = (int *) (f->buf + PS_FILTER_BLOCKSIZE);
+	f->codes = (unsigned short *) (f->keys + PS_LZW_HASHSIZE);
+	f->prefix = -1;
+	f->codebits = 9;
+	/* The output starts with a clear table marker, which cannot fill
+	 * the block */
+	ps_filter_lzw_clear(psdoc, f);
+	return(f);
+}
+/* }}} */
+
+/* ps_filter_predictor_new() {{{
+ * Creates a filter applying a png predictor to rows of columns samples
+ * with colors components of bpc bits. The predictor does not encode
+ * data on its own, its parameters are needed for decoding the data of
+ * the next filter.
+ */
+PSFILTER *ps_filter_predictor_new(PSDoc *psdoc, PSFILTER *next, int predictor, int colors, int bpc, int columns) {
+	PSFILTER *f;
+	size_t rowbytes;
+
+	rowbytes = ((size_t) colors * bpc * columns + 7) / 8;
+	if(rowbytes == 0 || next == NULL) {
+		ps_error(psdoc, PS_RuntimeError, _("Predictor cannot be applied to this data."));
+		return NULL;
+	}
+	if(NULL == (f = ps_filter_new(psdoc, PS_FILTER_PREDICTOR, next, NULL)))
+		return NULL;
+	/* Room for the incomplete row, the previous row, the predicted row
+	 * preceded by the png filter type and two rows for trying out
+	 * predictors */
+	if(NULL == (f->buf = psdoc->malloc(psdoc, 5*rowbytes + 1, _("Allocate memory for filter")))) {
+		psdoc->free(psdoc, f);
+		return NULL;
+	}
+	f->prev = f->buf + rowbytes;
+	f->out = f->buf + 2*rowbytes;
+	f->cand = f->buf + 3*rowbytes + 1;
+	f->best = f->buf + 4*rowbytes + 1;
+	memset(f->prev, 0, rowbytes);
+	f->predictor = predictor;
+	f->colors = colors;
+	f->bpc = bpc;
+	f->columns = columns;
+	f->rowbytes = rowbytes;
+	f->bpp = ((size_t) colors * bpc + 7) / 8;
+	next->parms = f;
+	return(f);
+}
+/* }}} */
+
+/* ps_filter_passthrough_new() {{{
+ * Creates a filter passing on data which is already encoded and can be
+ * decoded by the PostScript filter decodename
+ */
+PSFILTER *ps_filter_passthrough_new(PSDoc *psdoc, PSFILTER *next, const char *decodename) {
+	return(ps_filter_new(psdoc, PS_FILTER_PASSTHROUGH, next, decodename));
+}
+/* }}} */
+
+/* ps_filter_predicted_new() {{{
+ * Creates a filter passing on data which is already encoded like the
+ * data of a png file. Each row carries its png filter type, so decoding
+ * needs the parameters of a predictor.
+ */
+PSFILTER *ps_filter_predicted_new(PSDoc *psdoc, PSFILTER *next, const char *decodename, int colors, int bpc, int columns) {
+	PSFILTER *f;
+
+	if(NULL == (f = ps_filter_new(psdoc, PS_FILTER_PASSTHROUGH, next, decodename)))
+		return NULL;
+	f->predictor = PS_PREDICTOR_OPTIMUM;
+	f->colors = colors;
+	f->bpc = bpc;
+	f->columns = columns;
+	f->parms = f;
+	return(f);
+}
+/* }}} */
+
+/* ps_filter_subfile_new() {{{
+ * Creates a filter passing on binary data, which is decoded with
+ * /SubFileDecode reading exactly count bytes. If count is 0, the bytes
+ * passing the filter are counted, which requires the data to be
+ * collected by a buffer filter until the count has been output.
+ */
+PSFILTER *ps_filter_subfile_new(PSDoc *psdoc, PSFILTER *next, size_t count) {
+	PSFILTER *f;
+
+	if(NULL == (f = ps_filter_new(psdoc, PS_FILTER_SUBFILE, next, "SubFileDecode")))
+		return NULL;
+	f->count = count;
+	f->parms = f;
+	return(f);
+}
+/* }}} */
+
+/* ps_filter_buffer_new() {{{
+ * Creates a filter collecting data in the string buffer sb instead of
+ * writing it into the document
+ */
+PSFILTER *ps_filter_buffer_new(PSDoc *psdoc, STRBUFFER *sb) {
+	PSFILTER *f;
+
+	if(NULL == (f = ps_filter_new(psdoc, PS_FILTER_BUFFER, NULL, NULL)))
+		return NULL;
+	f->sb = sb;
+	return(f);
+}
+/* }}} */
+
+/* ps_filter_ascii85_write() {{{
+ * Encodes all complete groups of 4 bytes and keeps the rest for the
+ * next call
+ */
+static int ps_filter_ascii85_write(PSDoc *psdoc, PSFILTER *f, const unsigned char *data, size_t size) {
+	size_t n;
+
+	if(f->grouplen > 0) {
+		n = 4 - f->grouplen;
+		if(n > size)
+			n = size;
+		memcpy(&f->group[f->grouplen], data, n);
+		f->grouplen += n;
+		data += n;
+		size -= n;
+		if(f->grouplen < 4)
+			return(0);
+		ps_ascii85_groups(psdoc, f->group, 4, &f->cc);
+		f->grouplen = 0;
+	}
+	n = ps_ascii85_groups(psdoc, data, size, &f->cc);
+	memcpy(f->group, data + n, size - n);
+	f->grouplen = size - n;
+	return(0);
+}
+/* }}} */
+
+/* ps_filter_runlength_flush() {{{
+ * Encodes the collected block of data without the end of data marker
+ */
+static int ps_filter_runlength_flush(PSDoc *psdoc, PSFILTER *f) {
+	unsigned char *out = f->buf + PS_FILTER_BLOCKSIZE;
+	size_t len;
+
+	if(f->buflen == 0)
+		return(0);
+	len = ps_runlength_encode(out, f->buf, f->buflen) - 1;
+	f->buflen = 0;
+	return(ps_filter_pass(psdoc, f, out, len));
+}
+/* }}} */
+
+/* ps_filter_runlength_write() {{{
+ */
+static int ps_filter_runlength_write(PSDoc *psdoc, PSFILTER *f, const unsigned char *data, size_t size) {
+	size_t n;
+
+	while(size > 0) {
+		n = PS_FILTER_BLOCKSIZE - f->buflen;
+		if(n > size)
+			n = size;
+		memcpy(f->buf + f->buflen, data, n);
+		f->buflen += n;
+		data += n;
+		size -= n;
+		if(f->buflen == PS_FILTER_BLOCKSIZE && 0 != ps_filter_runlength_flush(psdoc, f))
+			return(-1);
+	}
+	return(0);
+}
+/* }}} */
+
+/* ps_filter_lzw_write() {{{
+ * Extends the pending string byte by byte as long as it is in the
+ * table. Otherwise the code of the pending string is output and the
+ * extended string is added to the table. The decoder adds the string
+ * one code later, which is why the code length grows when the code
+ * after the next one no longer fits.
+ */
+static int ps_filter_lzw_write(PSDoc *psdoc, PSFILTER *f, const unsigned char *data, size_t size) {
+	size_t i;
+	int key, h, disp;
+
+	for(i=0; i<size; i++) {
+		if(f->prefix < 0) {
+			f->prefix = data[i];
+			continue;
+		}
+		key = (f->prefix << 8) | data[i];
+		h = (data[i] << 4) ^ f->prefix;
+		disp = (h == 0) ? 1 : PS_LZW_HASHSIZE - h;
+		while(f->keys[h] != -1 && f->keys[h] != key) {
+			h -= disp;
+			if(h < 0)
+				h += PS_LZW_HASHSIZE;
+		}
+		if(f->keys[h] == key) {
+			f->prefix = f->codes[h];
+			continue;
+		}
+		if(0 != ps_filter_lzw_code(psdoc, f, f->prefix))
+			return(-1);
+		f->keys[h] = key;
+		f->codes[h] = f->nextcode++;
+		if(f->nextcode >= (1 << f->codebits))
+			f->codebits++;
+		if(f->nextcode + 1 >= PS_LZW_MAXCODES && 0 != ps_filter_lzw_clear(psdoc, f))
+			return(-1);
+		f->prefix = data[i];
+	}
+	return(0);
+}
+/* }}} */
+
+/* ps_filter_lzw_finish() {{{
+ * Outputs the pending string, the end of data marker and the remaining
+ * bits
+ */
+static int ps_filter_lzw_finish(PSDoc *psdoc, PSFILTER *f) {
+	size_t len;
+
+	if(f->prefix >= 0) {
+		if(0 != ps_filter_lzw_code(psdoc, f, f->prefix))
+			return(-1);
+		f->prefix = -1;
+		/* The decoder adds a string after reading the code */
+		if(f->nextcode > PS_LZW_FIRSTCODE && f->nextcode + 1 >= (1 << f->codebits))
+			f->codebits++;
+	}
+	if(0 != ps_filter_lzw_code(psdoc, f, PS_LZW_EOD))
+		return(-1);
+	if(f->nbits > 0)
+		f->buf[f->buflen++] = (f->bits << (8 - f->nbits)) & 0xff;
+	f->nbits = 0;
+	if(f->buflen == 0)
+		return(0);
+	len = f->buflen;
+	f->buflen = 0;
+	return(ps_filter_pass(psdoc, f, f->buf, len));
+}
+/* }}} */
+
+/* ps_predict_row() {{{
+ * Applies a png predictor to a row of rowbytes bytes. prev is the
+ * previous row, which is all zero for the first row. bpp is the
+ * number of bytes per pixel. The loops are kept simple, so the
+ * compiler can vectorize them.
+ */
+static void ps_predict_row(unsigned char *out, const unsigned char *in, const unsigned char *prev, size_t rowbytes, size_t bpp, int predictor) {
+	size_t i, first;
+
+	first = bpp < rowbytes ? bpp : rowbytes;
+	switch(predictor) {
+		case PS_PREDICTOR_SUB:
+			for(i=0; i<first; i++)
+				out[i] = in[i];
+			for(i=first; i<rowbytes; i++)
+				out[i] = in[i] - in[i-bpp];
+			break;
+		case PS_PREDICTOR_UP:
+			for(i=0; i<rowbytes; i++)
+				out[i] = in[i] - prev[i];
+			break;
+		case PS_PREDICTOR_AVERAGE:
+			for(i=0; i<first; i++)
+				out[i] = in[i] - (prev[i] >> 1);
+			for(i=first; i<rowbytes; i++)
+				out[i] = in[i] - ((in[i-bpp] + prev[i]) >> 1);
+			break;
+		case PS_PREDICTOR_PAETH:
+			/* The left and upper left pixels of the first pixel are 0,
+			 * which makes the upper pixel the prediction */
+			for(i=0; i<first; i++)
+				out[i] = in[i] - prev[i];
+			for(i=first; i<rowbytes; i++) {
+				int a = in[i-bpp], b = prev[i], c = prev[i-bpp];
+				int pa = abs(b - c), pb = abs(a - c), pc = abs(a + b - 2*c);
+				out[i] = in[i] - ((pa <= pb && pa <= pc) ? a : (pb <= pc ? b : c));
+			}
+			break;
+		default:
+			memcpy(out, in, rowbytes);
+	}
+}
+/* }}} */
+
+/* ps_predict_row_cost() {{{
+ * Sum of the absolute values of the predicted bytes taken as signed
+ * numbers. Smaller values usually compress better. This is the
+ * heuristic used by libpng for choosing a filter.
+ */
+static size_t ps_predict_row_cost(const unsigned char *row, size_t rowbytes) {
+	size_t i, cost = 0;
+
+	for(i=0; i<rowbytes; i++)
+		cost += row[i] < 128 ? row[i] : 256 - row[i];
+	return(cost);
+}
+/* }}} */
+
+/* ps_filter_predict() {{{
+ * Predicts a complete row and passes it on preceded by the png filter
+ * type
+ */
+static int ps_filter_predict(PSDoc *psdoc, PSFILTER *f, const unsigned char *row) {
+	unsigned char *tmp;
+	size_t cost, bestcost;
+	int type, besttype;
+
+	if(f->predictor == PS_PREDICTOR_OPTIMUM) {
+		besttype = PS_PREDICTOR_NONE;
+		bestcost = ps_predict_row_cost(row, f->rowbytes);
+		for(type=PS_PREDICTOR_SUB; type<=PS_PREDICTOR_PAETH; type++) {
+			ps_predict_row(f->cand, row, f->prev, f->rowbytes, f->bpp, type);
+			cost = ps_predict_row_cost(f->cand, f->rowbytes);
+			if(cost < bestcost) {
+				bestcost = cost;
+				besttype = type;
+				tmp = f->best;
+				f->best = f->cand;
+				f->cand = tmp;
+			}
+		}
+		f->out[0] = besttype;
+		memcpy(&f->out[1], besttype == PS_PREDICTOR_NONE ? row : f->best, f->rowbytes);
+	} else {
+		f->out[0] = f->predictor;
+		ps_predict_row(&f->out[1], row, f->prev, f->rowbytes, f->bpp, f->predictor);
+	}
+	if(row != f->prev)
+		memcpy(f->prev, row, f->rowbytes);
+	return(ps_filter_pass(psdoc, f, f->out, f->rowbytes + 1));
+}
+/* }}} */
+
+/* ps_filter_predictor_write() {{{
+ * Predicts complete rows right from the data and collects incomplete
+ * rows in the buffer of the filter
+ */
+static int ps_filter_predictor_write(PSDoc *psdoc, PSFILTER *f, const unsigned char *data, size_t size) {
+	const unsigned char *row;
+	size_t n;
+
+	while(size > 0) {
+		if(f->buflen == 0 && size >= f->rowbytes) {
+			row = data;
+			data += f->rowbytes;
+			size -= f->rowbytes;
+		} else {
+			n = f->rowbytes - f->buflen;
+			if(n > size)
+				n = size;
+			memcpy(f->buf + f->buflen, data, n);
+			f->buflen += n;
+			data += n;
+			size -= n;
+			if(f->buflen < f->rowbytes)
+				break;
+			row = f->buf;
+			f->buflen = 0;
+		}
+		if(0 != ps_filter_predict(psdoc, f, row))
+			return(-1);
+	}
+	return(0);
+}
+/* }}} */
+
+/* ps_filter_write() {{{
+ * Encodes data and passes the result on
+ */
+int ps_filter_write(PSDoc *psdoc, PSFILTER *f, const void *data, size_t size) {
+	if(f->error)
+		return(-1);
+	switch(f->type) {
+		case PS_FILTER_ASCII85:
+			f->error = ps_filter_ascii85_write(psdoc, f, data, size);
+			break;
+		case PS_FILTER_ASCIIHEX:
+			ps_write_hex_column(psdoc, data, size, f->bytesperline, &f->column);
+			break;
+		case PS_FILTER_FLATE:
+			f->error = ps_deflater_write(psdoc, f->deflater, data, size);
+			break;
+		case PS_FILTER_RUNLENGTH:
+			f->error = ps_filter_runlength_write(psdoc, f, data, size);
+			break;
+		case PS_FILTER_LZW:
+			f->error = ps_filter_lzw_write(psdoc, f, data, size);
+			break;
+		case PS_FILTER_PREDICTOR:
+			f->error = ps_filter_predictor_write(psdoc, f, data, size);
+			break;
+		case PS_FILTER_SUBFILE:
+			f->buflen += size;
+			f->error = ps_filter_pass(psdoc, f, data, size);
+			break;
+		case PS_FILTER_BUFFER:
+			if(str_buffer_write(psdoc, f->sb, data, size) != size)
+				f->error = -1;
+			break;
+		default:
+			f->error = ps_filter_pass(psdoc, f, data, size);
+	}
+	return(f->error);
+}
+/* }}} */
+
+/* ps_filter_close() {{{
+ * Passes on all pending data and the end of data marker and closes the
+ * following filters. The chain must still be freed with
+ * ps_filter_delete(). Returns -1 if any filter failed.
+ */
+int ps_filter_close(PSDoc *psdoc, PSFILTER *f) {
+	int ret = f->error;
+
+	switch(f->type) {
+		case PS_FILTER_ASCII85:
+			ps_ascii85_finish(psdoc, f->group, f->grouplen);
+			break;
+		case PS_FILTER_ASCIIHEX:
+			if(f->eod) {
+				ps_putc(psdoc, '\n');
+				ps_putc(psdoc, '>');
+			}
+			break;
+		case PS_FILTER_FLATE:
+			if(0 != ps_deflater_finish(psdoc, f->deflater))
+				ret = -1;
+			break;
+		case PS_FILTER_RUNLENGTH:
+			if(0 != ps_filter_runlength_flush(psdoc, f))
+				ret = -1;
+			f->buf[0] = 128;
+			ps_filter_pass(psdoc, f, f->buf, 1);
+			break;
+		case PS_FILTER_LZW:
+			if(0 != ps_filter_lzw_finish(psdoc, f))
+				ret = -1;
+			break;
+		case PS_FILTER_PREDICTOR:
+			/* An incomplete last row is padded with zeros */
+			if(f->buflen > 0) {
+				memset(f->buf + f->buflen, 0, f->rowbytes - f->buflen);
+				if(0 != ps_filter_predict(psdoc, f, f->buf))
+					ret = -1;
+				f->buflen = 0;
+			}
+			break;
+		case PS_FILTER_SUBFILE:
+			if(f->count == 0)
+				f->count = f->buflen;
+			else if(f->count != f->buflen) {
+				ps_error(psdoc, PS_RuntimeError, _("Number of bytes written differs from announced number."));
+				ret = -1;
+			}
+			break;
+	}
+	if(f->next && 0 != ps_filter_close(psdoc, f->next))
+		ret = -1;
+	return(ret ? -1 : 0);
+}
+/* }}} */
+
+/* ps_filter_delete() {{{
+ * Frees a filter and all following filters without passing on pending
+ * data
+ */
+void ps_filter_delete(PSDoc *psdoc, PSFILTER *f) {
+	PSFILTER *next;
+
+	while(f) {
+		next = f->next;
+		if(f->deflater)
+			ps_deflater_delete(psdoc, f->deflater);
+		if(f->buf)
+			psdoc->free(psdoc, f->buf);
+		psdoc->free(psdoc, f);
+		f = next;
+	}
+}
+/* }}} */
+
+/* ps_filter_decoders() {{{
+ * Collects the filters of a chain which need a PostScript filter for
+ * decoding their data, in the order of decoding
+ */
+static int ps_filter_decoders(PSFILTER *f, PSFILTER **decoders) {
+	PSFILTER *tmp;
+	int n = 0, i;
+
+	for(; f && n < PS_FILTER_MAXCHAIN; f = f->next)
+		if(f->decodename)
+			decoders[n++] = f;
+	for(i=0; i<n/2; i++) {
+		tmp = decoders[i];
+		decoders[i] = decoders[n-1-i];
+		decoders[n-1-i] = tmp;
+	}
+	return(n);
+}
+/* }}} */
+
+/* ps_filter_has_parms() {{{
+ * Checks if decoding the data of a filter needs parameters
+ */
+static int ps_filter_has_parms(PSFILTER *f) {
+	return(f->parms != NULL);
+}
+/* }}} */
+
+/* ps_filter_write_parms() {{{
+ * Outputs the decoding parameters of a filter as a dictionary. These
+ * are the parameters of its predictor or the number of bytes read by
+ * /SubFileDecode.
+ */
+static void ps_filter_write_parms(PSDoc *psdoc, PSFILTER *f) {
+	PSFILTER *p = f->parms;
+
+	if(f->type == PS_FILTER_SUBFILE) {
+		ps_printf(psdoc, "<< /EODCount %lu /EODString () >>", (unsigned long) f->count);
+		return;
+	}
+	ps_puts(psdoc, "<<");
+	if(p)
+		ps_printf(psdoc, " /Predictor %d /Colors %d /BitsPerComponent %d /Columns %d", 10 + p->predictor, p->colors, p->bpc, p->columns);
+	ps_puts(psdoc, " >>");
+}
+/* }}} */
+
+/* ps_filter_write_dict() {{{
+ * Outputs the /Filter and /DecodeParms entries of a dictionary for
+ * decoding the data of a chain
+ */
+void ps_filter_write_dict(PSDoc *psdoc, PSFILTER *f) {
+	PSFILTER *decoders[PS_FILTER_MAXCHAIN];
+	int n, i, hasparms = 0;
+
+	n = ps_filter_decoders(f, decoders);
+	if(n == 0)
+		return;
+	ps_puts(psdoc, "/Filter ");
+	if(n > 1)
+		ps_putc(psdoc, '[');
+	for(i=0; i<n; i++) {
+		ps_printf(psdoc, i ? " /%s" : "/%s", decoders[i]->decodename);
+		if(ps_filter_has_parms(decoders[i]))
+			hasparms = 1;
+	}
+	if(n > 1)
+		ps_putc(psdoc, ']');
+	if(hasparms) {
+		ps_puts(psdoc, " /DecodeParms ");
+		if(n > 1)
+			ps_putc(psdoc, '[');
+		for(i=0; i<n; i++) {
+			if(i)
+				ps_putc(psdoc, ' ');
+			if(ps_filter_has_parms(decoders[i]))
+				ps_filter_write_parms(psdoc, decoders[i]);
+			else
+				ps_puts(psdoc, "null");
+		}
+		if(n > 1)
+			ps_putc(psdoc, ']');
+	}
+}
+/* }}} */
+
+/* ps_filter_write_source() {{{
+ * Outputs code which reads the data of a chain from the current file
+ * and leaves the decoding filter on the stack
+ */
+void ps_filter_write_source(PSDoc *psdoc, PSFILTER *f) {
+	PSFILTER *decoders[PS_FILTER_MAXCHAIN];
+	int n, i;
+
+	n = ps_filter_decoders(f, decoders);
+	ps_puts(psdoc, "currentfile");
+	for(i=0; i<n; i++) {
+		ps_putc(psdoc, ' ');
+		/* The operands of /SubFileDecode work in language level 2 */
+		if(decoders[i]->type == PS_FILTER_SUBFILE) {
+			ps_printf(psdoc, "%lu () ", (unsigned long) decoders[i]->count);
+		} else if(ps_filter_has_parms(decoders[i])) {
+			ps_filter_write_parms(psdoc, decoders[i]);
+			ps_putc(psdoc, ' ');
+		}
+		ps_printf(psdoc, "/%s filter", decoders[i]->decodename);
+	}
+}
+/* }}} */
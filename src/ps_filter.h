@@ -0,0 +1,56 @@
+/*
+ *    (c) Copyright 2026  Uwe Steinmann.
+ *    All rights reserved.
+ *
+ *    This library is free software; you can redistribute it and/or
+ *    modify it under the terms of the GNU Lesser General Public
+ *    License as published by the Free Software Foundation; either
+ *    version 2 of the License, or (at your option) any later version.
+ *
+ *    This library is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *    Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with this library; if not, write to the
+ *    Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *    Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __PS_FILTER_H__
+#define __PS_FILTER_H__
+
+/* Types of filters */
+#define PS_FILTER_ASCII85     1
+#define PS_FILTER_ASCIIHEX    2
+#define PS_FILTER_FLATE       3
+#define PS_FILTER_RUNLENGTH   4
+#define PS_FILTER_PREDICTOR   5
+#define PS_FILTER_PASSTHROUGH 6
+#define PS_FILTER_SUBFILE     7
+#define PS_FILTER_BUFFER      8
+#define PS_FILTER_LZW         9
+
+/* Size of the blocks passed from one filter to the next */
+#define PS_FILTER_BLOCKSIZE 16384
+
+typedef struct ps_filter_ PSFILTER;
+
+PSFILTER *ps_filter_ascii85_new(PSDoc *psdoc);
+PSFILTER *ps_filter_asciihex_new(PSDoc *psdoc, size_t bytesperline, int eod);
+PSFILTER *ps_filter_flate_new(PSDoc *psdoc, PSFILTER *next, int level, int threads);
+PSFILTER *ps_filter_runlength_new(PSDoc *psdoc, PSFILTER *next);
+PSFILTER *ps_filter_lzw_new(PSDoc *psdoc, PSFILTER *next);
+PSFILTER *ps_filter_predictor_new(PSDoc *psdoc, PSFILTER *next, int predictor, int colors, int bpc, int columns);
+PSFILTER *ps_filter_passthrough_new(PSDoc *psdoc, PSFILTER *next, const char *decodename);
+PSFILTER *ps_filter_predicted_new(PSDoc *psdoc, PSFILTER *next, const char *decodename, int colors, int bpc, int columns);
+PSFILTER *ps_filter_subfile_new(PSDoc *psdoc, PSFILTER *next, size_t count);
+PSFILTER *ps_filter_buffer_new(PSDoc *psdoc, STRBUFFER *sb);
+int ps_filter_write(PSDoc *psdoc, PSFILTER *f, const void *data, size_t size);
+int ps_filter_close(PSDoc *psdoc, PSFILTER *f);
+void ps_filter_delete(PSDoc *psdoc, PSFILTER *f);
+void ps_filter_write_dict(PSDoc *psdoc, PSFILTER *f);
+void ps_filter_write_source(PSDoc *psdoc, PSFILTER *f);
+
+#endif
@@ -33,6 +33,10 @@
 #include "libps/psversion.h"
 #include "ps_list.h"
 #include "ps_strbuf.h"
+#include "ps_writer.h"
+#include "ps_deflate.h"
+#include "ps_filter.h"
+#include "ps_digest.h"
 #include "ght_hash_table.h"
 #ifdef HAVE_LIBPNJ
 #include "libhnj/hyphen.h"
@@ -175,6 +179,47 @@ struct PSImage_ {
 	int numcolors;
 	PSImage *imagemask; // Use other image a s mask for this image
 	ps_bool isreusable;
+	char *filename; // eps and png files are not read into data but copied from here
+	int compression; // PS_IMAGECOMP_*, data is kept compressed as in the file
+	ps_bool inverted; // cmyk data is inverted as in jpeg files written by Adobe
+	int refcount; // number of times the image was opened and not closed
+	int decoding; // PS_DECODE_*, if not PS_DECODE_OPEN the data is read from filename when placed
+	ps_bool cached; // image is in the image cache under digest
+	unsigned char digest[PS_DIGEST_MAXSIZE];
+	unsigned int page; // page on which the reusable data was defined, 0 for none
+};
+
+typedef struct PSImageFilter_ PSImageFilter;
+
+struct PSImageFilter_ {
+	int encoding;  // PS_IMAGEENC_*
+	int predictor; // PS_PREDICTOR_*, only used if data is compressed
+	int compression; // PS_IMAGECOMP_* of data passed through as it is
+	int colors;    // Layout of the samples as needed by the predictor
+	int bpc;
+	int columns;
+	PSFILTER *chain; // Filters encoding the data
+	const char *data; // Samples with components values per pixel
+	size_t len;
+	int components;
+	ps_bool binary; // Data is written without ASCII encoding
+	size_t outlength; // Number of bytes of binary data
+	STRBUFFER *buffer; // Compressed binary data collected in advance
+	ps_bool streamed; // Data is passed in parts, see ps_init_image_stream()
+	ps_bool framed; // Binary data is counted and enclosed in %%BeginData
+	ps_bool closed; // All data has passed the chain
+};
+
+typedef struct PSImageStream_ PSImageStream;
+
+struct PSImageStream_ {
+	PSImage *image; // Image begun with PS_begin_image()
+	int imageid;
+	size_t rowbytes;
+	int rows;       // Number of rows written so far
+	ps_bool placed; // Image which is not reusable has been placed
+	ps_bool started; // Code reading the data has been output
+	PSImageFilter filter;
 };
 
 typedef struct PSFont_ PSFont;
@@ -324,9 +369,55 @@ struct bookmark_ {
 #define PS_SCOPE_PROLOG   64
 #define PS_SCOPE_FONT     128
 #define PS_SCOPE_GLYPH    256
+#define PS_SCOPE_IMAGE    512
 
 #define LINEBUFLEN    1024
 
+/* Default size of the output buffer in front of the write procedure */
+#define PS_OUTPUT_BUFFER_SIZE 16384
+
+/* Files included with less bytes are copied through the output buffer
+ * instead of flushing it and copying them with sendfile() */
+#define PS_SENDFILE_MIN 65536
+
+/* Approximate size of the band of rows decoded at a time when png files
+ * are read row by row */
+#define PS_IMAGE_BANDSIZE 65536
+
+/* Maximum number of bytes in a line output by ps_write_hex() */
+#define PS_HEX_MAXLINE 64
+
+/* Encodings of image data selected by the parameter 'imageencoding' */
+#define PS_IMAGEENC_ASCII85   0
+#define PS_IMAGEENC_HEX       1
+#define PS_IMAGEENC_FLATE     2
+#define PS_IMAGEENC_RUNLENGTH 3
+#define PS_IMAGEENC_LZW       4
+/* Chooses one of the above for each image by looking at its samples */
+#define PS_IMAGEENC_AUTO      5
+
+/* Compression of image data which is embedded as it was read from the
+ * file, selected by the parameter 'imagepassthrough' */
+#define PS_IMAGECOMP_NONE  0
+#define PS_IMAGECOMP_DCT   1
+#define PS_IMAGECOMP_FLATE 2 /* IDAT data of png files */
+
+/* Time at which image files are decoded, selected by the parameter
+ * 'imagedecoding' */
+#define PS_DECODE_OPEN      0 /* when the image is opened */
+#define PS_DECODE_LAZY      1 /* when the image is placed the first time */
+#define PS_DECODE_TRANSIENT 2 /* each time the image is placed */
+
+/* Predictors applied to image data before compression, selected by the
+ * parameter 'imagepredictor'. The values are the png filter types,
+ * PS_PREDICTOR_OPTIMUM chooses the best of them for each row. */
+#define PS_PREDICTOR_NONE    0
+#define PS_PREDICTOR_SUB     1
+#define PS_PREDICTOR_UP      2
+#define PS_PREDICTOR_AVERAGE 3
+#define PS_PREDICTOR_PAETH   4
+#define PS_PREDICTOR_OPTIMUM 5
+
 struct PSDoc_ {
 	/* Document Information */
 	char  *Keywords;
@@ -340,6 +431,7 @@ struct PSDoc_ {
 	int copies;
 
 	STRBUFFER *sb;
+	size_t sbsizehint;   /* Expected size of a document created in memory */
 	FILE *fp;
 	ps_bool closefp;
 	ps_bool headerwritten;
@@ -377,6 +469,7 @@ struct PSDoc_ {
 	unsigned int page;
 	int in_error;
 	ps_bool warnings;          /* Whether warnings shall be output */
+	ps_bool builtinprintf;     /* Whether ps_printf() uses its own formater */
 
 	/* The stack of scopes */
 	int scopecount;
@@ -387,6 +480,9 @@ struct PSDoc_ {
 	int fontcnt;
 	PSImage **images;
 	int imagecnt;
+	ght_hash_table_t *imagecache; /* opened images by digest of their source */
+	int imagedatacnt;             /* number of reusable images, for naming them */
+	PSImageStream *imagestream;   /* image whose rows are being written */
 	PSPattern **patterns;
 	int patterncnt;
 	PSShading **shadings;
@@ -426,6 +522,57 @@ struct PSDoc_ {
 	/* output function */
 	size_t  (*writeproc)(PSDoc *p, void *data, size_t size);
 
+	/* output buffer. Everything written with ps_write() is collected in
+	 * this buffer and passed to writeproc() when the buffer is full, a
+	 * page ends or the document is closed. */
+	char *outbuf;
+	size_t outbufsize;
+	size_t outbuflen;
+
+	/* writer thread used by PS_open_fp() if writerthread is set */
+	ps_bool writerthread;
+	PSWRITER *writer;
+
+	/* compression of the output, set by the parameter outputcompression */
+	int outputcompression;       /* PS_DEFLATE_XXX or -1 for no compression */
+	int outputcompressionlevel;  /* 0-9 or -1 for the zlib default */
+	PSDEFLATER *deflater;
+
+	/* level of flate compressed image data, 0-9 or -1 for the zlib default */
+	int imagecompressionlevel;
+
+	/* number of threads compressing image data, 0 for none */
+	int compressionthreads;
+
+	/* PostScript language level of the output set by the value
+	 * languagelevel, 0 if not set. Level 2 uses LZW instead of flate. */
+	int languagelevel;
+
+	/* statistics. outpos is the number of bytes passed from the output
+	 * buffer to the write procedure or the deflater. Bytes are added to
+	 * the current category statcategory when it changes. */
+	unsigned long long outpos;
+	PSStats stats;
+	int statcategory;
+	unsigned long long statcategorystart;
+	int timerdepth[PS_STATS_TIMERS];
+	double timerstart[PS_STATS_TIMERS];
+	PSPageStats *pagestats;
+	int pagestatssize;
+	PSDocIndex index;
+
+	/* checksums. digest is computed over all bytes passed to the write
+	 * procedure, pagedigest over the uncompressed bytes of the current
+	 * page starting at pagedigeststart. */
+	int digesttype;
+	PSDIGEST *digest;
+	PSDIGEST *pagedigest;
+	ps_bool pagedigestopen;
+	unsigned long long pagedigeststart;
+	unsigned char docdigest[PS_DIGEST_MAXSIZE];
+	int docdigestsize;
+	unsigned char *pagedigests;  /* PS_DIGEST_MAXSIZE bytes for each page */
+
 	/* user data passed by PS_new2(). Can be retrieved with PS_get_opaque() */
 	void *user_data;
 
@@ -441,6 +588,19 @@ struct PSDoc_ {
 
 /* ps_util.c */
 void ps_write(PSDoc *p, const void *data, size_t size);
+void ps_flush(PSDoc *p);
+int ps_set_output_buffer(PSDoc *p, size_t size);
+size_t ps_output_sink(PSDoc *p, void *data, size_t size);
+size_t ps_output_deflated(PSDoc *p, void *sinkdata, const void *data, size_t size);
+long ps_write_file(PSDoc *p, FILE *fp, long length);
+char *ps_output_space(PSDoc *p, size_t size);
+unsigned long long ps_tell(PSDoc *p);
+int ps_set_stats_category(PSDoc *p, int category);
+void ps_stats_reset(PSDoc *p);
+void ps_stats_start_timer(PSDoc *p, int timer);
+void ps_stats_stop_timer(PSDoc *p, int timer);
+void ps_stats_begin_page(PSDoc *p);
+void ps_stats_end_page(PSDoc *p);
 void ps_putc(PSDoc *p, char c);
 void ps_puts(PSDoc *p, const char *s);
 void ps_printf(PSDoc *p, const char *fmt, ...);
@@ -477,8 +637,26 @@ int get_optlist_element_as_float(PSDoc *psdoc, ght_hash_table_t *opthash, const
 int get_optlist_element_as_int(PSDoc *psdoc, ght_hash_table_t *opthash, const char *name, int *value);
 int get_optlist_element_as_bool(PSDoc *psdoc, ght_hash_table_t *opthash, const char *name, ps_bool *value);
 int get_optlist_element_as_string(PSDoc *psdoc, ght_hash_table_t *opthash, const char *name, char **value);
-void ps_ascii85_encode(PSDoc *psdoc, char *data, size_t len);
-void ps_asciihex_encode(PSDoc *psdoc, char *data, size_t len);
+size_t ps_ascii85_groups(PSDoc *psdoc, const unsigned char *in, size_t len, int *ccptr);
+void ps_ascii85_finish(PSDoc *psdoc, const unsigned char *in, size_t len);
+void ps_write_hex_column(PSDoc *p, const unsigned char *data, size_t len, size_t bytesperline, size_t *column);
+void ps_write_hex(PSDoc *p, const unsigned char *data, size_t len, size_t bytesperline);
+int ps_get_image_encoding(PSDoc *psdoc);
+int ps_get_image_predictor(PSDoc *psdoc);
+int ps_get_binary_data(PSDoc *psdoc);
+size_t ps_runlength_encode(unsigned char *out, const unsigned char *in, size_t len);
+int ps_probe_image_encoding(PSDoc *psdoc, const char *data, size_t len);
+int ps_read_jpeg_header(PSDoc *psdoc, FILE *fp, PSImage *image);
+size_t ps_png_idat_length(FILE *fp, int width, int height, int bpc, int colors);
+int ps_write_png_idat(PSDoc *psdoc, FILE *fp, PSImageFilter *filter);
+void ps_init_image_filter(PSDoc *psdoc, PSImageFilter *filter, int colors, int components, int bpc, int columns, int compression, const char *data, size_t len);
+void ps_write_image_filter(PSDoc *psdoc, PSImageFilter *filter);
+void ps_write_image_datasource(PSDoc *psdoc, PSImageFilter *filter);
+void ps_write_image_data(PSDoc *psdoc, PSImageFilter *filter, const char *op);
+void ps_init_image_stream(PSDoc *psdoc, PSImageFilter *filter, int colors, int bpc, int columns, int compression, const char *sample, size_t samplelen, size_t len);
+void ps_begin_image_data(PSDoc *psdoc, PSImageFilter *filter, const char *op);
+void ps_write_image_stream(PSDoc *psdoc, PSImageFilter *filter, const char *data, size_t len);
+void ps_end_image_data(PSDoc *psdoc, PSImageFilter *filter);
 
 /* ps_afm.c */
 int calculatekern(ADOBEINFO *ai, ADOBEINFO *succ);
@@ -25,34 +25,88 @@
 #include "ps_intern.h"
 #include "ps_error.h"
 
+/* str_buffer_chunk_new() {{{
+ * Allocates a new empty chunk and appends it to the list of chunks
+ */
+static STRBUFFERCHUNK *str_buffer_chunk_new(PSDoc *psdoc, STRBUFFER *sb, size_t size) {
+	STRBUFFERCHUNK *chunk;
+	if(NULL == (chunk = psdoc->malloc(psdoc, sizeof(STRBUFFERCHUNK), _("Allocate memory for string buffer chunk"))))
+		return NULL;
+	if(NULL == (chunk->data = psdoc->malloc(psdoc, size, _("Allocate memory for string buffer chunk")))) {
+		psdoc->free(psdoc, chunk);
+		return NULL;
+	}
+	chunk->start = 0;
+	chunk->sealed = 0;
+	chunk->len = 0;
+	chunk->size = size;
+	chunk->next = NULL;
+	if(sb->last)
+		sb->last->next = chunk;
+	else
+		sb->first = chunk;
+	sb->last = chunk;
+	return(chunk);
+}
+/* }}} */
+
 /* str_buffer_new() {{{
- * Create a new string buffer with the given initial size
+ * Create a new string buffer. The size is a hint for the expected
+ * size of the content. It is used as the size of the first chunk.
  */
 STRBUFFER *str_buffer_new(PSDoc *psdoc, size_t size) {
 	STRBUFFER *sb;
 	if(NULL == (sb = psdoc->malloc(psdoc, sizeof(STRBUFFER), _("Allocate memory for string buffer"))))
 		return NULL;
-	if(size > 0) {
-		if(NULL == (sb->buffer = psdoc->malloc(psdoc, size, _("Allocate memory for string buffer")))) {
-			psdoc->free(psdoc, sb);
-			return NULL;
-		}
-		sb->buffer[0] = '\0';
-	} else {
-		sb->buffer = NULL;
+	sb->first = sb->cur = sb->last = sb->drained = NULL;
+	sb->len = 0;
+	if(size < STRBUFFER_MIN_CHUNK)
+		size = STRBUFFER_MIN_CHUNK;
+	if(NULL == (sb->cur = str_buffer_chunk_new(psdoc, sb, size))) {
+		psdoc->free(psdoc, sb);
+		return NULL;
 	}
-	sb->size = size;
-	sb->cur = 0;
+	sb->chunksize = min(2*size, STRBUFFER_MAX_CHUNK);
 	return(sb);
 }
 /* }}} */
 
+/* str_buffer_chunks_free() {{{
+ * Frees a list of chunks
+ */
+static void str_buffer_chunks_free(PSDoc *psdoc, STRBUFFERCHUNK *chunk) {
+	STRBUFFERCHUNK *next;
+	for(; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		psdoc->free(psdoc, chunk->data);
+		psdoc->free(psdoc, chunk);
+	}
+}
+/* }}} */
+
+/* str_buffer_recycle() {{{
+ * Appends the chunks drained by the last call of str_buffer_drain()
+ * to the list of chunks, which makes them available for new data.
+ */
+static void str_buffer_recycle(STRBUFFER *sb) {
+	STRBUFFERCHUNK *chunk, *next;
+	for(chunk = sb->drained; chunk != NULL; chunk = next) {
+		next = chunk->next;
+		chunk->start = chunk->sealed = chunk->len = 0;
+		chunk->next = NULL;
+		sb->last->next = chunk;
+		sb->last = chunk;
+	}
+	sb->drained = NULL;
+}
+/* }}} */
+
 /* str_buffer_delete() {{{
  * Frees the memory occupied by the string buffer include the struct itself
  */
 void str_buffer_delete(PSDoc *psdoc, STRBUFFER *sb) {
-	if(sb->buffer)
-		psdoc->free(psdoc, sb->buffer);
+	str_buffer_chunks_free(psdoc, sb->first);
+	str_buffer_chunks_free(psdoc, sb->drained);
 	psdoc->free(psdoc, sb);
 }
 /* }}} */
@@ -68,52 +122,91 @@ size_t str_buffer_print(PSDoc *psdoc, STRBUFFER *sb, const char *fmt, ...) {
 
 	va_start(ap, fmt);
 	written = vsnprintf(msg, MSG_BUFSIZE, fmt, ap);
+	va_end(ap);
 	if(written >= MSG_BUFSIZE) {
 		ps_error(psdoc, PS_IOError, _("Format string in string buffer is to short"));
 		return -1;
 	}
 
-	/* Enlarge memory for buffer
-	 * Enlarging it MSG_BUFSIZE ensure that the space is in any case
-	 * sufficient to add the new string.
-	 */
-	if((sb->cur + written + 1) > sb->size) {
-		sb->buffer = psdoc->realloc(psdoc, sb->buffer, sb->size+MSG_BUFSIZE, _("Get more memory for string buffer."));
-		sb->size += MSG_BUFSIZE;
-	}
-	strcpy(&(sb->buffer[sb->cur]), msg);
-	sb->cur += written;
-
-	va_end(ap);
-	return(written);
+	return(str_buffer_write(psdoc, sb, msg, written));
 }
 /* }}} */
 #undef MSG_BUFSIZE
 
 /* str_buffer_write() {{{
  * write a string at the end of a buffer
+ * The data is copied into the current chunk as far as it fits. The
+ * remaining data goes into the next chunk which is either an unused
+ * chunk or a newly allocated one. The size of new chunks is doubled
+ * each time until it reaches STRBUFFER_MAX_CHUNK. Existing data is
+ * never copied.
  */
 size_t str_buffer_write(PSDoc *psdoc, STRBUFFER *sb, const char *data, size_t size) {
-	/* Enlarge memory for buffer
-	 * Enlarging it MSG_BUFSIZE ensure that the space is in any case
-	 * sufficient to add the new string.
-	 */
-	if((sb->cur + size + 1) > sb->size) {
-		sb->buffer = psdoc->realloc(psdoc, sb->buffer, sb->size+max(size, 2000), _("Get more memory for string buffer."));
-		sb->size += max(size, 2000);
+	size_t written = 0;
+
+	while(written < size) {
+		STRBUFFERCHUNK *chunk = sb->cur;
+		size_t n;
+
+		if(chunk->len == chunk->size) {
+			if(chunk->next) {
+				chunk = chunk->next;
+			} else {
+				if(NULL == (chunk = str_buffer_chunk_new(psdoc, sb, sb->chunksize))) {
+					ps_error(psdoc, PS_MemoryError, _("Could not get more memory for string buffer."));
+					return(written);
+				}
+				sb->chunksize = min(2*sb->chunksize, STRBUFFER_MAX_CHUNK);
+			}
+			sb->cur = chunk;
+		}
+		n = min(size - written, chunk->size - chunk->len);
+		memcpy(&(chunk->data[chunk->len]), &data[written], n);
+		chunk->len += n;
+		sb->len += n;
+		written += n;
 	}
-	memcpy(&(sb->buffer[sb->cur]), data, size);
-	sb->cur += size;
-	sb->buffer[sb->cur+1] = '\0';
 	return(size);
 }
 /* }}} */
 
 /* str_buffer_get() {{{
- * Returns a pointer to current buffer
+ * Returns a pointer to current buffer. If the content is spread over
+ * several chunks, they will be copied into one chunk before. The
+ * returned buffer is always terminated by 0.
  */
 const char *str_buffer_get(PSDoc *psdoc, STRBUFFER *sb) {
-	return(sb->buffer);
+	STRBUFFERCHUNK *chunk, *all;
+
+	if(sb->len == 0)
+		str_buffer_clear(psdoc, sb);
+	if(sb->first->start == 0 && sb->first->len == sb->len && sb->len < sb->first->size) {
+		sb->first->data[sb->len] = '\0';
+		return(sb->first->data);
+	}
+
+	/* Coalesce all chunks into one */
+	if(NULL == (all = psdoc->malloc(psdoc, sizeof(STRBUFFERCHUNK), _("Allocate memory for string buffer chunk"))))
+		return NULL;
+	if(NULL == (all->data = psdoc->malloc(psdoc, sb->len+1, _("Allocate memory for string buffer chunk")))) {
+		psdoc->free(psdoc, all);
+		return NULL;
+	}
+	all->len = 0;
+	for(chunk = sb->first; chunk != NULL; chunk = chunk->next) {
+		memcpy(&(all->data[all->len]), &(chunk->data[chunk->start]), chunk->len - chunk->start);
+		all->len += chunk->len - chunk->start;
+	}
+	str_buffer_chunks_free(psdoc, sb->first);
+	str_buffer_chunks_free(psdoc, sb->drained);
+	all->data[all->len] = '\0';
+	all->start = 0;
+	all->sealed = 0;
+	all->size = sb->len+1;
+	all->next = NULL;
+	sb->first = sb->cur = sb->last = all;
+	sb->drained = NULL;
+	return(all->data);
 }
 /* }}} */
 
@@ -121,7 +214,7 @@ const char *str_buffer_get(PSDoc *psdoc, STRBUFFER *sb) {
  * Returns len of string buffer
  */
 size_t str_buffer_len(PSDoc *psdoc, STRBUFFER *sb) {
-	return(sb->cur);
+	return(sb->len);
 }
 /* }}} */
 
@@ -129,8 +222,82 @@ size_t str_buffer_len(PSDoc *psdoc, STRBUFFER *sb) {
  * Clears the string buffer but will not free the memory
  */
 void str_buffer_clear(PSDoc *psdoc, STRBUFFER *sb) {
-	sb->cur = 0;
+	STRBUFFERCHUNK *chunk;
+	str_buffer_recycle(sb);
+	for(chunk = sb->first; chunk != NULL; chunk = chunk->next)
+		chunk->start = chunk->sealed = chunk->len = 0;
+	sb->cur = sb->first;
+	sb->len = 0;
 }
 /* }}} */
 
+/* str_buffer_get_chunks() {{{
+ * Fills the array chunks with pointers to the data in each non empty
+ * chunk without coalescing them. Returns the number of non empty chunks.
+ * If chunks is NULL or maxchunks is too small, nothing is filled in.
+ */
+int str_buffer_get_chunks(STRBUFFER *sb, PSBufferChunk *chunks, int maxchunks) {
+	STRBUFFERCHUNK *chunk;
+	int i, count = 0;
+
+	for(chunk = sb->first; chunk != NULL; chunk = chunk->next)
+		if(chunk->len > chunk->start)
+			count++;
+	if(NULL == chunks || count > maxchunks)
+		return(count);
+	for(i = 0, chunk = sb->first; i < count; chunk = chunk->next) {
+		if(chunk->len > chunk->start) {
+			chunks[i].data = &(chunk->data[chunk->start]);
+			chunks[i].size = chunk->len - chunk->start;
+			i++;
+		}
+	}
+	return(count);
+}
+/* }}} */
+
+/* str_buffer_seal() {{{
+ * Marks all data written so far as complete. It will be returned by
+ * the next call of str_buffer_drain() even if the current chunk is
+ * not full yet.
+ */
+void str_buffer_seal(STRBUFFER *sb) {
+	sb->cur->sealed = sb->cur->len;
+}
+/* }}} */
+
+/* str_buffer_drain() {{{
+ * Fills the array chunks with up to maxchunks pieces of complete data
+ * and removes them from the buffer. Complete data are all full chunks
+ * and the data marked by str_buffer_seal(). The returned memory stays
+ * untouched until the next call of this function or str_buffer_clear().
+ * Returns the number of pieces filled in, which is 0 if there is no
+ * complete data.
+ */
+int str_buffer_drain(STRBUFFER *sb, PSBufferChunk *chunks, int maxchunks) {
+	STRBUFFERCHUNK *chunk;
+	int count = 0;
+
+	str_buffer_recycle(sb);
+	while(count < maxchunks) {
+		size_t end;
+		chunk = sb->first;
+		end = (chunk == sb->cur) ? chunk->sealed : chunk->len;
+		if(end > chunk->start) {
+			chunks[count].data = &(chunk->data[chunk->start]);
+			chunks[count].size = end - chunk->start;
+			sb->len -= end - chunk->start;
+			chunk->start = end;
+			count++;
+		}
+		if(chunk == sb->cur)
+			break;
+		/* The chunk is completely drained */
+		sb->first = chunk->next;
+		chunk->next = sb->drained;
+		sb->drained = chunk;
+	}
+	return(count);
+}
+/* }}} */
 
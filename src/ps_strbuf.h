@@ -21,10 +21,34 @@
 #ifndef __PS_STRBUF_H__
 #define __PS_STRBUF_H__
 
+/* Smallest and largest size of a newly allocated chunk. Chunks grow
+ * geometrically between those sizes. */
+#define STRBUFFER_MIN_CHUNK 4096
+#define STRBUFFER_MAX_CHUNK (1024*1024)
+
+struct str_buffer_chunk_ {
+	char *data;
+	size_t start;  /* Number of bytes already drained */
+	size_t sealed; /* Number of bytes marked as complete */
+	size_t len;    /* Number of bytes used */
+	size_t size;   /* Number of bytes allocated */
+	struct str_buffer_chunk_ *next;
+};
+
+typedef struct str_buffer_chunk_ STRBUFFERCHUNK;
+
+/* A string buffer is a list of chunks. Data is appended to the chunk
+ * cur. Chunks after cur are empty and will be reused before new
+ * chunks are allocated. Chunks before cur are complete and can be
+ * drained. Drained chunks are kept in the list drained until the next
+ * call of str_buffer_drain(), because the caller may still use them. */
 struct str_buffer_ {
-	char *buffer;
-	size_t cur;
-	size_t size;
+	STRBUFFERCHUNK *first;
+	STRBUFFERCHUNK *cur;
+	STRBUFFERCHUNK *last;
+	STRBUFFERCHUNK *drained;
+	size_t len;        /* Number of bytes in all chunks not drained yet */
+	size_t chunksize;  /* Size of next chunk to be allocated */
 };
 
 typedef struct str_buffer_ STRBUFFER;
@@ -36,5 +60,8 @@ size_t str_buffer_write(PSDoc *psdoc, STRBUFFER *sb, const char *data, size_t si
 const char *str_buffer_get(PSDoc *psdoc, STRBUFFER *sb);
 size_t str_buffer_len(PSDoc *psdoc, STRBUFFER *sb);
 void str_buffer_clear(PSDoc *psdoc, STRBUFFER *sb);
+int str_buffer_get_chunks(STRBUFFER *sb, PSBufferChunk *chunks, int maxchunks);
+void str_buffer_seal(STRBUFFER *sb);
+int str_buffer_drain(STRBUFFER *sb, PSBufferChunk *chunks, int maxchunks);
 
 #endif
@@ -28,18 +28,388 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <string.h>
+#include <math.h>
+#include <time.h>
+#ifdef HAVE_SYS_TIME_H
+#include <sys/time.h>
+#endif
+#ifdef HAVE_SYS_SENDFILE_H
+#include <sys/sendfile.h>
+#include <unistd.h>
+#endif
 #include "ps_intern.h"
 #include "ps_memory.h"
 #include "ps_fontenc.h"
 #include "ps_inputenc.h"
 #include "ps_error.h"
 
+/* ps_output_sink() {{{
+ * Calls the current writeprocedure and counts the calls for the
+ * statistics.
+ */
+size_t
+ps_output_sink(PSDoc *p, void *data, size_t size) {
+	p->stats.writecalls++;
+	p->stats.outbytes += size;
+	if(p->digest)
+		ps_digest_update(p->digest, data, size);
+	return(p->writeproc(p, data, size));
+}
+/* }}} */
+
+/* ps_output_deflated() {{{
+ * Sink of the deflater compressing the output
+ */
+size_t
+ps_output_deflated(PSDoc *p, void *sinkdata, const void *data, size_t size) {
+	(void) sinkdata;
+	return(ps_output_sink(p, (void *) data, size));
+}
+/* }}} */
+
+/* ps_output() {{{
+ * Passes a block of output to the current writeprocedure. If the output
+ * is compressed, the block is passed to the deflater, which calls the
+ * writeprocedure with the compressed data.
+ */
+static void
+ps_output(PSDoc *p, const void *data, size_t size) {
+	size_t skip;
+
+	/* Only the part belonging to the current page goes into its checksum */
+	if(p->pagedigestopen && p->outpos + size > p->pagedigeststart) {
+		skip = (p->pagedigeststart > p->outpos) ? (size_t) (p->pagedigeststart - p->outpos) : 0;
+		ps_digest_update(p->pagedigest, (const char *) data + skip, size - skip);
+	}
+	p->outpos += size;
+	if(p->deflater)
+		(void) ps_deflater_write(p, p->deflater, data, size);
+	else
+		(void) ps_output_sink(p, (void *) data, size);
+}
+/* }}} */
+
+/* ps_tell() {{{
+ * Returns the number of bytes output so far, including those still
+ * in the output buffer. Compression is not taken into account.
+ */
+unsigned long long
+ps_tell(PSDoc *p) {
+	return(p->outpos + p->outbuflen);
+}
+/* }}} */
+
+/* ps_set_stats_category() {{{
+ * Sets the category to which all following output is accounted.
+ * The output since the last change is added to the previous category,
+ * which is returned, so it can be restored afterwards. Only the
+ * functions writing text, images, fonts and resources change the
+ * category, everything else is accounted to the category of the
+ * current page, template, pattern or font.
+ */
+int
+ps_set_stats_category(PSDoc *p, int category) {
+	int oldcategory;
+	unsigned long long pos;
+
+	if(NULL == p)
+		return(PS_STATS_OTHER);
+	oldcategory = p->statcategory;
+	if(category == oldcategory)
+		return(oldcategory);
+	pos = ps_tell(p);
+	p->stats.bytes[oldcategory] += pos - p->statcategorystart;
+	p->statcategorystart = pos;
+	p->statcategory = category;
+	return(oldcategory);
+}
+/* }}} */
+
+/* ps_stats_reset() {{{
+ * Resets the position, the statistics, the index and the checksums
+ * at the start of a document. A PSDoc may be used for several
+ * documents, each of them starting at position 0.
+ */
+void
+ps_stats_reset(PSDoc *p) {
+	int i;
+
+	p->outpos = 0;
+	memset(&(p->stats), 0, sizeof(PSStats));
+	p->statcategory = PS_STATS_OTHER;
+	p->statcategorystart = 0;
+	for(i = 0; i < PS_STATS_TIMERS; i++)
+		p->timerdepth[i] = 0;
+	if(p->pagestats)
+		memset(p->pagestats, 0, p->pagestatssize * sizeof(PSPageStats));
+	memset(&(p->index), 0, sizeof(PSDocIndex));
+	p->pagedigestopen = ps_false;
+	p->pagedigeststart = 0;
+	p->docdigestsize = 0;
+}
+/* }}} */
+
+/* ps_wallclock() {{{
+ * Returns the current time in seconds
+ */
+static double
+ps_wallclock(void) {
+#ifdef HAVE_SYS_TIME_H
+	struct timeval tv;
+	gettimeofday(&tv, NULL);
+	return((double) tv.tv_sec + (double) tv.tv_usec / 1000000.0);
+#else
+	return((double) clock() / (double) CLOCKS_PER_SEC);
+#endif
+}
+/* }}} */
+
+/* ps_stats_start_timer() {{{
+ * Starts measuring the time for one of the PS_STATS_TIME_* timers.
+ * Calls may be nested, only the outermost pair is measured.
+ */
+void
+ps_stats_start_timer(PSDoc *p, int timer) {
+	if(NULL == p)
+		return;
+	if(p->timerdepth[timer]++ == 0)
+		p->timerstart[timer] = ps_wallclock();
+}
+/* }}} */
+
+/* ps_stats_stop_timer() {{{
+ * Stops measuring the time started with ps_stats_start_timer()
+ */
+void
+ps_stats_stop_timer(PSDoc *p, int timer) {
+	if(NULL == p || p->timerdepth[timer] == 0)
+		return;
+	if(--(p->timerdepth[timer]) == 0)
+		p->stats.time[timer] += ps_wallclock() - p->timerstart[timer];
+}
+/* }}} */
+
+/* ps_stats_begin_page() {{{
+ * Records the position of the current page, which must have been
+ * counted already in p->page.
+ */
+void
+ps_stats_begin_page(PSDoc *p) {
+	void *mem;
+	int size;
+
+	if((int) p->page > p->pagestatssize) {
+		size = (p->pagestatssize == 0) ? 16 : 2 * p->pagestatssize;
+		/* The checksums of a previous document may still be kept */
+		if(p->pagedigests) {
+			if(NULL == (mem = p->realloc(p, p->pagedigests, size * PS_DIGEST_MAXSIZE, _("Allocate memory for page checksums.")))) {
+				ps_error(p, PS_MemoryError, _("Could not allocate memory for page checksums."));
+				return;
+			}
+			p->pagedigests = mem;
+		}
+		if(NULL == p->pagestats)
+			mem = p->malloc(p, size * sizeof(PSPageStats), _("Allocate memory for page statistics."));
+		else
+			mem = p->realloc(p, p->pagestats, size * sizeof(PSPageStats), _("Allocate memory for page statistics."));
+		if(NULL == mem) {
+			ps_error(p, PS_MemoryError, _("Could not allocate memory for page statistics."));
+			return;
+		}
+		p->pagestats = mem;
+		p->pagestatssize = size;
+	}
+	/* Checksums may have been turned on after the page statistics of
+	 * an earlier document were allocated */
+	if(p->pagedigest && NULL == p->pagedigests) {
+		if(NULL == (p->pagedigests = p->malloc(p, p->pagestatssize * PS_DIGEST_MAXSIZE, _("Allocate memory for page checksums.")))) {
+			ps_error(p, PS_MemoryError, _("Could not allocate memory for page checksums."));
+			return;
+		}
+	}
+	p->pagestats[p->page-1].offset = ps_tell(p);
+	p->pagestats[p->page-1].size = 0;
+	p->stats.pages = (int) p->page;
+	if(p->pagedigest) {
+		p->pagedigeststart = p->pagestats[p->page-1].offset;
+		p->pagedigestopen = ps_true;
+	}
+}
+/* }}} */
+
+/* ps_stats_end_page() {{{
+ * Records the size of the current page
+ */
+void
+ps_stats_end_page(PSDoc *p) {
+	if((int) p->page > p->pagestatssize)
+		return;
+	p->pagestats[p->page-1].size = ps_tell(p) - p->pagestats[p->page-1].offset;
+	/* The end of the page must have passed ps_output() before the
+	 * checksum is complete */
+	if(p->pagedigestopen) {
+		ps_flush(p);
+		ps_digest_final(p->pagedigest, &(p->pagedigests[(p->page-1) * PS_DIGEST_MAXSIZE]));
+		p->pagedigestopen = ps_false;
+	}
+}
+/* }}} */
+
+/* ps_flush() {{{
+ * Passes everything collected in the output buffer to the current
+ * writeprocedure
+ */
+void
+ps_flush(PSDoc *p) {
+	if(p->outbuflen > 0) {
+		ps_output(p, p->outbuf, p->outbuflen);
+		p->outbuflen = 0;
+	}
+}
+/* }}} */
+
+/* ps_set_output_buffer() {{{
+ * Sets the size of the output buffer. The current content of the buffer
+ * is flushed before. A size of 0 turns off buffering. Returns -1 if
+ * the memory for the buffer could not be allocated, in which case
+ * output is unbuffered.
+ */
+int
+ps_set_output_buffer(PSDoc *p, size_t size) {
+	if(p->writeproc)
+		ps_flush(p);
+	if(p->outbuf) {
+		p->free(p, p->outbuf);
+		p->outbuf = NULL;
+	}
+	p->outbufsize = 0;
+	p->outbuflen = 0;
+	if(size > 0) {
+		if(NULL == (p->outbuf = p->malloc(p, size, _("Allocate memory for output buffer.")))) {
+			ps_error(p, PS_MemoryError, _("Could not allocate memory for output buffer."));
+			return(-1);
+		}
+		p->outbufsize = size;
+	}
+	return(0);
+}
+/* }}} */
+
 /* ps_write() {{{
- * Output data using the current writeprocedure
+ * Output data using the current writeprocedure. The data is collected
+ * in the output buffer. Only if it does not fit into the buffer the
+ * buffer is flushed. Data which is larger than the buffer is passed
+ * to the writeprocedure directly.
  */
 void
 ps_write(PSDoc *p, const void *data, size_t size) {
-	(void) p->writeproc(p, (void *) data, size);
+	if(size > p->outbufsize - p->outbuflen) {
+		ps_flush(p);
+		if(size >= p->outbufsize) {
+			ps_output(p, data, size);
+			return;
+		}
+	}
+	memcpy(&(p->outbuf[p->outbuflen]), data, size);
+	p->outbuflen += size;
+}
+/* }}} */
+
+#ifdef HAVE_SYS_SENDFILE_H
+/* ps_sendfile() {{{
+ * Lets the kernel copy length bytes from the current position of fp
+ * into the output file. Everything output before is flushed, because
+ * the data bypasses the output buffer. Returns the number of bytes
+ * copied, which is less than length if the kernel cannot copy between
+ * the two files. The position of fp is set behind the copied data.
+ */
+static long
+ps_sendfile(PSDoc *p, FILE *fp, long length) {
+	off_t offset;
+	ssize_t n;
+	long copied = 0;
+
+	if((offset = ftell(fp)) < 0)
+		return(0);
+	ps_flush(p);
+	if(0 != fflush(p->fp))
+		return(0);
+	while(copied < length) {
+		n = sendfile(fileno(p->fp), fileno(fp), &offset, (size_t) (length - copied));
+		if(n < 0 && errno == EINTR)
+			continue;
+		if(n <= 0)
+			break;
+		copied += n;
+	}
+	if(copied > 0) {
+		p->outpos += copied;
+		p->stats.outbytes += copied;
+		p->stats.writecalls++;
+		fseek(fp, offset, SEEK_SET);
+	}
+	return(copied);
+}
+/* }}} */
+#endif
+
+/* ps_write_file() {{{
+ * Outputs length bytes from the current position of fp without reading
+ * the whole file into memory. If the document is written uncompressed
+ * and without checksums into a file by the calling thread, the data is
+ * copied by the kernel.
+ * Otherwise it is read directly into the output buffer. Returns the
+ * number of bytes output, which is less than length if the file is
+ * shorter.
+ */
+long
+ps_write_file(PSDoc *p, FILE *fp, long length) {
+	char buffer[4096];
+	size_t n, len;
+	long copied = 0;
+
+#ifdef HAVE_SYS_SENDFILE_H
+	if(p->fp && NULL == p->deflater && NULL == p->writer && NULL == p->digest && NULL == p->pagedigest && length >= PS_SENDFILE_MIN)
+		copied = ps_sendfile(p, fp, length);
+#endif
+	while(copied < length) {
+		if(p->outbufsize > 0) {
+			if(p->outbuflen == p->outbufsize)
+				ps_flush(p);
+			len = p->outbufsize - p->outbuflen;
+			if((long) len > length - copied)
+				len = length - copied;
+			if(0 == (n = fread(&(p->outbuf[p->outbuflen]), 1, len, fp)))
+				break;
+			p->outbuflen += n;
+		} else {
+			len = sizeof(buffer);
+			if((long) len > length - copied)
+				len = length - copied;
+			if(0 == (n = fread(buffer, 1, len, fp)))
+				break;
+			ps_write(p, buffer, n);
+		}
+		copied += n;
+	}
+	return(copied);
+}
+/* }}} */
+
+/* ps_output_space() {{{
+ * Returns a pointer to at least size free bytes in the output buffer,
+ * which is flushed if needed. The caller writes its data right into
+ * the buffer and adds its length to p->outbuflen. Returns NULL if the
+ * buffer is smaller than size.
+ */
+char *
+ps_output_space(PSDoc *p, size_t size) {
+	if(size > p->outbufsize - p->outbuflen) {
+		ps_flush(p);
+		if(size > p->outbufsize)
+			return(NULL);
+	}
+	return(&(p->outbuf[p->outbuflen]));
 }
 /* }}} */
 
@@ -49,7 +419,10 @@ ps_write(PSDoc *p, const void *data, size_t size) {
 void
 ps_putc(PSDoc *p, char c)
 {
-	ps_write(p, (void *) &c, (size_t) 1);
+	if(p->outbuflen < p->outbufsize)
+		p->outbuf[p->outbuflen++] = c;
+	else
+		ps_write(p, (void *) &c, (size_t) 1);
 }
 /* }}} */
 
@@ -63,8 +436,287 @@ ps_puts(PSDoc *p, const char *s)
 }
 /* }}} */
 
+/* Powers of ten used by ps_format_double() */
+static const double ps_pow10[] = {
+	1.0, 10.0, 100.0, 1000.0, 10000.0, 100000.0,
+	1000000.0, 10000000.0, 100000000.0, 1000000000.0
+};
+
+/* ps_format_libc_double() {{{
+ * Formats a floating point number with vsnprintf() and replaces the
+ * decimal point of the current locale by '.'. This is only used for
+ * numbers which cannot be handled by ps_format_double().
+ */
+static int
+ps_format_libc_double(char *buf, size_t len, double value, int prec)
+{
+	struct lconv *lc;
+	char *ptr;
+	int n;
+
+	n = snprintf(buf, len, "%.*f", prec, value);
+	if(n < 0 || (size_t) n >= len)
+		return(-1);
+	lc = localeconv();
+	if(lc->decimal_point && strcmp(lc->decimal_point, ".")) {
+		size_t dplen = strlen(lc->decimal_point);
+		if(dplen > 0 && NULL != (ptr = strstr(buf, lc->decimal_point))) {
+			*ptr = '.';
+			memmove(ptr+1, ptr+dplen, strlen(ptr+dplen)+1);
+			n -= (int) dplen - 1;
+		}
+	}
+	return(n);
+}
+/* }}} */
+
+/* ps_format_double() {{{
+ * Formats a floating point number with prec digits after the decimal
+ * point into buf without taking the locale into account. The result
+ * is the same as printf("%.*f") would return in the C locale. Returns
+ * the number of chars written or -1 if the number is out of range or
+ * too close to a rounding boundary to be formated reliably. buf must
+ * have room for at least 32 chars.
+ */
+static int
+ps_format_double(char *buf, double value, int prec)
+{
+	char digits[32];
+	double a, s, ip, frac, n;
+	int i, nd;
+	char *ptr = buf;
+
+	if(prec < 0 || prec > 9 || value != value)
+		return(-1);
+	a = (value < 0.0) ? -value : value;
+	s = a * ps_pow10[prec];
+	/* Also catches infinity */
+	if(!(s < 1e15))
+		return(-1);
+	ip = floor(s);
+	frac = s - ip;
+	/* The multiplication above may have been inexact. Leave ties to libc,
+	 * which rounds with the exact binary value. */
+	if(fabs(frac - 0.5) <= s * 1e-15 + 1e-300)
+		return(-1);
+	n = (frac > 0.5) ? ip + 1.0 : ip;
+
+	/* Convert the scaled integer into digits, least significant first.
+	 * All values are below 2^53 and thus exact. */
+	nd = 0;
+	do {
+		double q = floor(n / 10.0);
+		digits[nd++] = '0' + (int) (n - q * 10.0);
+		n = q;
+	} while(n > 0.0);
+	while(nd <= prec)
+		digits[nd++] = '0';
+
+	if(value < 0.0 || (value == 0.0 && 1.0 / value < 0.0))
+		*ptr++ = '-';
+	for(i = nd-1; i >= prec; i--)
+		*ptr++ = digits[i];
+	if(prec > 0) {
+		*ptr++ = '.';
+		for(i = prec-1; i >= 0; i--)
+			*ptr++ = digits[i];
+	}
+	*ptr = '\0';
+	return((int) (ptr - buf));
+}
+/* }}} */
+
+/* ps_format_ulong() {{{
+ * Formats an unsigned integer in the given base into buf, which must
+ * have room for at least 32 chars. Returns the number of chars written.
+ */
+static int
+ps_format_ulong(char *buf, unsigned long value, unsigned int base, int upper)
+{
+	const char *hexdigits = upper ? "0123456789ABCDEF" : "0123456789abcdef";
+	char digits[32];
+	int i, nd = 0;
+
+	do {
+		digits[nd++] = hexdigits[value % base];
+		value /= base;
+	} while(value > 0);
+	for(i = 0; i < nd; i++)
+		buf[i] = digits[nd-1-i];
+	buf[nd] = '\0';
+	return(nd);
+}
+/* }}} */
+
+/* ps_printf_builtin_ok() {{{
+ * Checks whether all conversions in fmt can be handled by
+ * ps_vprintf_builtin(). Supported are %d, %i, %u, %o, %x, %X (optionally
+ * with 'l'), %c, %s, %f and %% with the flags '-' and '0', a field
+ * width and a precision for %f.
+ */
+static int
+ps_printf_builtin_ok(const char *fmt)
+{
+	const char *ptr = fmt;
+
+	while(NULL != (ptr = strchr(ptr, '%'))) {
+		int prec = 0;
+		ptr++;
+		while(*ptr == '-' || *ptr == '0')
+			ptr++;
+		while(*ptr >= '0' && *ptr <= '9')
+			ptr++;
+		if(*ptr == '.') {
+			prec = 1;
+			ptr++;
+			while(*ptr >= '0' && *ptr <= '9')
+				ptr++;
+		}
+		if(*ptr == 'l') {
+			ptr++;
+			if(!strchr("diuoxX", *ptr))
+				return(0);
+		}
+		if(*ptr == '\0' || !strchr("diuoxXcsf%", *ptr))
+			return(0);
+		if(prec && *ptr != 'f')
+			return(0);
+		ptr++;
+	}
+	return(1);
+}
+/* }}} */
+
+/* ps_write_padded() {{{
+ * Outputs a formated conversion consisting of a prefix (the sign) and
+ * the body. The result is padded to width chars either with spaces
+ * or with zeros between prefix and body.
+ */
+static void
+ps_write_padded(PSDoc *p, const char *prefix, int prefixlen, const char *body, int bodylen, int width, int leftalign, int zeropad)
+{
+	int pad = width - prefixlen - bodylen;
+
+	if(pad > 0 && !leftalign && !zeropad)
+		while(pad-- > 0)
+			ps_putc(p, ' ');
+	if(prefixlen > 0)
+		ps_write(p, prefix, prefixlen);
+	if(pad > 0 && !leftalign && zeropad)
+		while(pad-- > 0)
+			ps_putc(p, '0');
+	ps_write(p, body, bodylen);
+	if(pad > 0 && leftalign)
+		while(pad-- > 0)
+			ps_putc(p, ' ');
+}
+/* }}} */
+
+/* ps_vprintf_builtin() {{{
+ * Locale independent replacement for vsnprintf() which writes directly
+ * into the output buffer. fmt must have passed ps_printf_builtin_ok().
+ */
+static void
+ps_vprintf_builtin(PSDoc *p, const char *fmt, va_list ap)
+{
+	char tmp[64];
+	const char *ptr = fmt;
+	const char *start;
+
+	while(*ptr) {
+		int leftalign = 0, zeropad = 0, width = 0, prec = -1, islong = 0;
+		int n;
+
+		start = ptr;
+		while(*ptr && *ptr != '%')
+			ptr++;
+		if(ptr > start)
+			ps_write(p, start, ptr-start);
+		if(*ptr == '\0')
+			break;
+
+		ptr++;
+		for(;; ptr++) {
+			if(*ptr == '-')
+				leftalign = 1;
+			else if(*ptr == '0')
+				zeropad = 1;
+			else
+				break;
+		}
+		while(*ptr >= '0' && *ptr <= '9')
+			width = width*10 + (*ptr++ - '0');
+		if(*ptr == '.') {
+			ptr++;
+			prec = 0;
+			while(*ptr >= '0' && *ptr <= '9')
+				prec = prec*10 + (*ptr++ - '0');
+		}
+		if(*ptr == 'l') {
+			islong = 1;
+			ptr++;
+		}
+
+		switch(*ptr) {
+			case 'd':
+			case 'i': {
+				long value = islong ? va_arg(ap, long) : (long) va_arg(ap, int);
+				unsigned long uvalue = (value < 0) ? 0UL - (unsigned long) value : (unsigned long) value;
+				n = ps_format_ulong(tmp, uvalue, 10, 0);
+				ps_write_padded(p, "-", (value < 0) ? 1 : 0, tmp, n, width, leftalign, zeropad);
+				break;
+			}
+			case 'u':
+			case 'o':
+			case 'x':
+			case 'X': {
+				unsigned long uvalue = islong ? va_arg(ap, unsigned long) : (unsigned long) va_arg(ap, unsigned int);
+				unsigned int base = (*ptr == 'o') ? 8 : ((*ptr == 'u') ? 10 : 16);
+				n = ps_format_ulong(tmp, uvalue, base, *ptr == 'X');
+				ps_write_padded(p, NULL, 0, tmp, n, width, leftalign, zeropad);
+				break;
+			}
+			case 'c':
+				tmp[0] = (char) va_arg(ap, int);
+				ps_write_padded(p, NULL, 0, tmp, 1, width, leftalign, 0);
+				break;
+			case 's': {
+				const char *str = va_arg(ap, const char *);
+				if(NULL == str)
+					str = "(null)";
+				ps_write_padded(p, NULL, 0, str, strlen(str), width, leftalign, 0);
+				break;
+			}
+			case 'f': {
+				double value = va_arg(ap, double);
+				if(prec < 0)
+					prec = 6;
+				if(0 > (n = ps_format_double(tmp, value, prec)))
+					n = ps_format_libc_double(tmp, sizeof(tmp), value, prec);
+				if(n < 0) {
+					ps_error(p, PS_Warning, _("Could not format floating point number."));
+					break;
+				}
+				if(tmp[0] == '-')
+					ps_write_padded(p, tmp, 1, tmp+1, n-1, width, leftalign, zeropad);
+				else
+					ps_write_padded(p, NULL, 0, tmp, n, width, leftalign, zeropad);
+				break;
+			}
+			case '%':
+				ps_putc(p, '%');
+				break;
+		}
+		ptr++;
+	}
+}
+/* }}} */
+
 /* ps_printf() {{{
- * Output formated string
+ * Output formated string. Unless turned off with the parameter
+ * 'numberformat' the formating is done by ps_vprintf_builtin() which
+ * does not depend on the locale. Format strings it cannot handle are
+ * passed to vsnprintf().
  */
 void
 ps_printf(PSDoc *p, const char *fmt, ...)
@@ -74,10 +726,14 @@ ps_printf(PSDoc *p, const char *fmt, ...)
 
 	va_start(ap, fmt);
 
-	setlocale(LC_NUMERIC, "C");
-	(void) vsnprintf(buf, LINEBUFLEN, fmt, ap);
-	setlocale(LC_NUMERIC, "");
-	ps_puts(p, buf);
+	if(p->builtinprintf && ps_printf_builtin_ok(fmt)) {
+		ps_vprintf_builtin(p, fmt, ap);
+	} else {
+		setlocale(LC_NUMERIC, "C");
+		(void) vsnprintf(buf, LINEBUFLEN, fmt, ap);
+		setlocale(LC_NUMERIC, "");
+		ps_puts(p, buf);
+	}
 
 	va_end(ap);
 }
@@ -662,76 +1318,758 @@ FILE *ps_open_file_in_path(PSDoc *psdoc, const char *filename) {
 }
 /* }}} */
 
-int pow85[5] = {1, 85, 85*85, 85*85*85, 85*85*85*85};
-	
-/* ps_ascii85_encode() {{{
+/* ps_ascii85_groups() {{{
+ * Outputs all complete groups of 4 bytes of data ASCII85 encoded and
+ * returns the number of bytes consumed. Each group is turned into
+ * 5 characters by dividing by the constant 85, which the compiler
+ * replaces by a multiplication and shift. Lines are put together right
+ * in the output buffer. A line ends after the group which makes the
+ * counter *ccptr (4 for a group, 1 for a 'z') exceed 55, so a line has
+ * at most 73 characters and the newline. The counter is kept between
+ * calls for data passed in pieces.
  */
-void ps_ascii85_encode(PSDoc *psdoc, char *data, size_t len) {
-	unsigned long buffer;
-	unsigned char c;
-	int i, count, cc;
+size_t ps_ascii85_groups(PSDoc *psdoc, const unsigned char *in, size_t len, int *ccptr) {
+	char line[80], *start, *out;
+	unsigned int buffer, q;
+	size_t count;
+	int cc;
 
-	buffer = 0;
 	count = 0;
-	cc = 0;
-	while(count <= len-4) {
-//		buffer = ((long) data[count] << 24) + ((long) data[count+1] << 16) + ((long) data[count+2] << 8) + (long) data[count+3];
-		buffer |= ((unsigned char) data[count] << 24);
-		buffer |= ((unsigned char) data[count+1] << 16);
-		buffer |= ((unsigned char) data[count+2] << 8);
-		buffer |= ((unsigned char) data[count+3]);
-
-		if(buffer == 0) {
-			ps_putc(psdoc, 'z');
-			cc++;
-		} else {
-			for(i=4; i>=0; i--) {
-				c = (unsigned int) buffer / pow85[i];
-				ps_putc(psdoc, c+'!');
-				buffer = (unsigned int) buffer % pow85[i];
+	cc = *ccptr;
+	while(len - count >= 4) {
+		if(NULL == (start = ps_output_space(psdoc, sizeof(line))))
+			start = line;
+		out = start;
+		while(len - count >= 4) {
+			buffer = ((unsigned int) in[count] << 24) | ((unsigned int) in[count+1] << 16) |
+			         ((unsigned int) in[count+2] << 8) | (unsigned int) in[count+3];
+			count += 4;
+			if(buffer == 0) {
+				*out++ = 'z';
+				cc++;
+			} else {
+				q = buffer / 85;
+				out[4] = (char) (buffer - q * 85) + '!';
+				buffer = q / 85;
+				out[3] = (char) (q - buffer * 85) + '!';
+				q = buffer / 85;
+				out[2] = (char) (buffer - q * 85) + '!';
+				buffer = q / 85;
+				out[1] = (char) (q - buffer * 85) + '!';
+				out[0] = (char) buffer + '!';
+				out += 5;
+				cc += 4;
+			}
+			if(cc > 55) {
+				*out++ = '\n';
+				cc = 0;
+				break;
 			}
-			cc += 4;
-		}
-		count += 4;
-		if(cc > 55) {
-			ps_putc(psdoc, '\n');
-			cc = 0;
 		}
+		if(start == line)
+			ps_write(psdoc, line, out - line);
+		else
+			psdoc->outbuflen += out - start;
 	}
-	if(len-count) {
+	*ccptr = cc;
+	return(count);
+}
+/* }}} */
+
+/* ps_ascii85_finish() {{{
+ * Outputs the last len (less than 4) bytes of ASCII85 encoded data and
+ * the end of data marker
+ */
+void ps_ascii85_finish(PSDoc *psdoc, const unsigned char *in, size_t len) {
+	char tail[5];
+	unsigned int buffer;
+	size_t i;
+
+	if(len > 0) {
 		buffer = 0;
-		for(i=0; i<len-count; i++)
-			buffer = (buffer << 8) + (long) data[count+i];
-		buffer = buffer << ((4-len+count)*8);
-		for(i=4; i>=4-len+count; i--) {
-			c = (unsigned int) buffer / pow85[i];
-			ps_putc(psdoc, c+'!');
-			buffer = (unsigned int) buffer % pow85[i];
+		for(i=0; i<4; i++) {
+			buffer <<= 8;
+			if(i < len)
+				buffer |= in[i];
+		}
+		for(i=5; i>0; i--) {
+			tail[i-1] = (char) (buffer % 85) + '!';
+			buffer /= 85;
+		}
+		ps_write(psdoc, tail, len+1);
+	}
+	ps_write(psdoc, "~>", 2);
+}
+/* }}} */
+
+/* Two lowercase hex digits for each byte value */
+static const char ps_hexpairs[] =
+	"000102030405060708090a0b0c0d0e0f101112131415161718191a1b1c1d1e1f"
+	"202122232425262728292a2b2c2d2e2f303132333435363738393a3b3c3d3e3f"
+	"404142434445464748494a4b4c4d4e4f505152535455565758595a5b5c5d5e5f"
+	"606162636465666768696a6b6c6d6e6f707172737475767778797a7b7c7d7e7f"
+	"808182838485868788898a8b8c8d8e8f909192939495969798999a9b9c9d9e9f"
+	"a0a1a2a3a4a5a6a7a8a9aaabacadaeafb0b1b2b3b4b5b6b7b8b9babbbcbdbebf"
+	"c0c1c2c3c4c5c6c7c8c9cacbcccdcecfd0d1d2d3d4d5d6d7d8d9dadbdcdddedf"
+	"e0e1e2e3e4e5e6e7e8e9eaebecedeeeff0f1f2f3f4f5f6f7f8f9fafbfcfdfeff";
+
+/* ps_write_hex_column() {{{
+ * Outputs data as hex digits, two for each byte. If bytesperline is
+ * not 0, a newline is inserted after each bytesperline bytes, but not
+ * after the last byte. *column is the number of bytes already in the
+ * current line, which allows to output data in pieces. bytesperline
+ * may not exceed PS_HEX_MAXLINE. The lines are put together in the
+ * output buffer.
+ */
+void ps_write_hex_column(PSDoc *p, const unsigned char *data, size_t len, size_t bytesperline, size_t *column) {
+	char line[2*PS_HEX_MAXLINE+2], *start, *out;
+	size_t n, i;
+	int newline;
+
+	while(len > 0) {
+		/* The previous piece of data ended at the end of a line */
+		newline = 0;
+		if(bytesperline > 0 && *column == bytesperline) {
+			newline = 1;
+			*column = 0;
 		}
+		n = (bytesperline == 0) ? PS_HEX_MAXLINE : bytesperline - *column;
+		if(n > len)
+			n = len;
+		if(NULL == (start = ps_output_space(p, 2*n+2)))
+			start = line;
+		out = start;
+		if(newline)
+			*out++ = '\n';
+		for(i=0; i<n; i++) {
+			out[0] = ps_hexpairs[2*data[i]];
+			out[1] = ps_hexpairs[2*data[i]+1];
+			out += 2;
+		}
+		data += n;
+		len -= n;
+		if(bytesperline > 0) {
+			*column += n;
+			if(*column == bytesperline && len > 0) {
+				*out++ = '\n';
+				*column = 0;
+			}
+		}
+		if(start == line)
+			ps_write(p, line, out - line);
+		else
+			p->outbuflen += out - start;
 	}
-	ps_putc(psdoc, '~');
-	ps_putc(psdoc, '>');
 }
 /* }}} */
 
-/* ps_asciihex_encode() {{{
+/* ps_write_hex() {{{
+ * Outputs data as hex digits in lines of bytesperline bytes
  */
-void ps_asciihex_encode(PSDoc *psdoc, char *data, size_t len) {
-	int i, cc=0;
-	unsigned char *dataptr;
+void ps_write_hex(PSDoc *p, const unsigned char *data, size_t len, size_t bytesperline) {
+	size_t column = 0;
 
-	dataptr = data;
-	for(i=0; i<len; i++) {
-		ps_printf(psdoc, "%02x", *dataptr);
-		dataptr ++;
-		cc++;
-		if(cc > 35 && i < (len-1)) {
-			ps_printf(psdoc, "\n");
-			cc = 0;
+	ps_write_hex_column(p, data, len, bytesperline, &column);
+}
+/* }}} */
+
+/* ps_read_jpeg_header() {{{
+ * Reads the size and number of components of a jpeg file from its frame
+ * header and checks for the Adobe marker, which indicates inverted cmyk
+ * data. Returns 0 if the image data can be decoded by the DCTDecode
+ * filter and -1 otherwise. Progressive images are only decoded by the
+ * filter of LanguageLevel 3. The file is rewound in any case.
+ */
+int ps_read_jpeg_header(PSDoc *psdoc, FILE *fp, PSImage *image) {
+	unsigned char buf[16];
+	int marker, len, found = 0;
+
+	image->inverted = ps_false;
+	if(getc(fp) != 0xFF || getc(fp) != 0xD8) {
+		rewind(fp);
+		return(-1);
+	}
+	for(;;) {
+		if(getc(fp) != 0xFF)
+			break;
+		/* Markers may be preceded by any number of fill bytes */
+		while((marker = getc(fp)) == 0xFF)
+			;
+		if(marker == EOF || marker == 0xD9 || marker == 0xDA)
+			break;
+		if(marker == 0x01 || (marker >= 0xD0 && marker <= 0xD8))
+			continue;
+		if(2 != fread(buf, 1, 2, fp))
+			break;
+		len = ((buf[0] << 8) | buf[1]) - 2;
+		if(len < 0)
+			break;
+		if(marker >= 0xC0 && marker <= 0xCF && marker != 0xC4 && marker != 0xC8 && marker != 0xCC) {
+			/* Only baseline, extended and progressive huffman coded
+			 * images with 8 bit samples can be passed through */
+			if(marker > 0xC2 || len < 6 || 6 != fread(buf, 1, 6, fp) || buf[0] != 8)
+				break;
+			if(marker == 0xC2 && psdoc->languagelevel == 2)
+				break;
+			image->height = (buf[1] << 8) | buf[2];
+			image->width = (buf[3] << 8) | buf[4];
+			image->components = buf[5];
+			len -= 6;
+			found = 1;
+		} else if(marker == 0xEE && len >= 5) {
+			if(5 != fread(buf, 1, 5, fp))
+				break;
+			if(0 == memcmp(buf, "Adobe", 5))
+				image->inverted = ps_true;
+			len -= 5;
 		}
+		if(len > 0 && 0 != fseek(fp, len, SEEK_CUR))
+			break;
 	}
-	ps_putc(psdoc, '\n');
-	ps_putc(psdoc, '>');
+	rewind(fp);
+	if(!found || image->width <= 0 || image->height <= 0)
+		return(-1);
+	image->bpc = 8;
+	switch(image->components) {
+		case 1:
+			image->colorspace = PS_COLORSPACE_GRAY;
+			break;
+		case 3:
+			image->colorspace = PS_COLORSPACE_RGB;
+			break;
+		case 4:
+			image->colorspace = PS_COLORSPACE_CMYK;
+			break;
+		default:
+			return(-1);
+	}
+	return(0);
+}
+/* }}} */
+
+/* ps_png_idat_length() {{{
+ * Returns the number of bytes in the IDAT chunks of a png file, which
+ * together form the compressed image data. Returns 0 if the chunks
+ * cannot be read or the header of the file does not match the image
+ * with the given width, height, bits per component and number of color
+ * components. The file is rewound in any case.
+ */
+size_t ps_png_idat_length(FILE *fp, int width, int height, int bpc, int colors) {
+	unsigned char buf[8], ihdr[13+4];
+	size_t len, total = 0;
+
+	/* The IHDR chunk always comes first */
+	if(0 != fseek(fp, 8, SEEK_SET) ||
+	   8 != fread(buf, 1, 8, fp) || 0 != memcmp(buf, "\0\0\0\15IHDR", 8) ||
+	   sizeof(ihdr) != fread(ihdr, 1, sizeof(ihdr), fp) ||
+	   (((unsigned long) ihdr[0] << 24) | (ihdr[1] << 16) | (ihdr[2] << 8) | ihdr[3]) != (unsigned long) width ||
+	   (((unsigned long) ihdr[4] << 24) | (ihdr[5] << 16) | (ihdr[6] << 8) | ihdr[7]) != (unsigned long) height ||
+	   ihdr[8] != bpc || (ihdr[9] == 2 ? 3 : 1) != colors || ihdr[12] != 0) {
+		rewind(fp);
+		return(0);
+	}
+	while(8 == fread(buf, 1, 8, fp)) {
+		len = ((size_t) buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+		if(0 == memcmp(buf+4, "IEND", 4)) {
+			rewind(fp);
+			return(total);
+		}
+		if(0 == memcmp(buf+4, "IDAT", 4))
+			total += len;
+		/* Skip the data and the crc */
+		if(0 != fseek(fp, len + 4, SEEK_CUR))
+			break;
+	}
+	/* The file ends before the IEND chunk */
+	rewind(fp);
+	return(0);
+}
+/* }}} */
+
+/* ps_write_png_idat() {{{
+ * Passes the content of the IDAT chunks of a png file to the image data
+ * set up in filter. Returns -1 if the file could not be read completely.
+ */
+int ps_write_png_idat(PSDoc *psdoc, FILE *fp, PSImageFilter *filter) {
+	unsigned char buf[8];
+	char data[8192];
+	size_t len, n;
+
+	if(0 != fseek(fp, 8, SEEK_SET))
+		return(-1);
+	while(8 == fread(buf, 1, 8, fp)) {
+		len = ((size_t) buf[0] << 24) | (buf[1] << 16) | (buf[2] << 8) | buf[3];
+		if(0 == memcmp(buf+4, "IEND", 4))
+			return(0);
+		if(0 == memcmp(buf+4, "IDAT", 4)) {
+			while(len > 0) {
+				n = fread(data, 1, len < sizeof(data) ? len : sizeof(data), fp);
+				if(n == 0)
+					return(-1);
+				ps_write_image_stream(psdoc, filter, data, n);
+				len -= n;
+			}
+		} else if(0 != fseek(fp, len, SEEK_CUR))
+			return(-1);
+		if(0 != fseek(fp, 4, SEEK_CUR))
+			return(-1);
+	}
+	return(-1);
+}
+/* }}} */
+
+/* ps_get_image_encoding() {{{
+ * Returns the encoding of image data as set by the parameter
+ * 'imageencoding'
+ */
+int ps_get_image_encoding(PSDoc *psdoc) {
+	const char *imgenc;
+
+	imgenc = PS_get_parameter(psdoc, "imageencoding", 0.0);
+	if(imgenc == NULL)
+		return(PS_IMAGEENC_ASCII85);
+	if(0 == strcmp(imgenc, "hex"))
+		return(PS_IMAGEENC_HEX);
+	if(0 == strcmp(imgenc, "runlength"))
+		return(PS_IMAGEENC_RUNLENGTH);
+	if(0 == strcmp(imgenc, "lzw"))
+		return(PS_IMAGEENC_LZW);
+	if(0 == strcmp(imgenc, "auto"))
+		return(PS_IMAGEENC_AUTO);
+	if(0 == strcmp(imgenc, "flate")) {
+#ifdef HAVE_LIBZ
+		return(PS_IMAGEENC_FLATE);
+#else
+		ps_error(psdoc, PS_Warning, _("pslib was compiled without zlib. Image data will be compressed with LZW."));
+		return(PS_IMAGEENC_LZW);
+#endif
+	}
+	return(PS_IMAGEENC_ASCII85);
+}
+/* }}} */
+
+/* ps_get_image_predictor() {{{
+ * Returns the predictor for compressed image data as set by the
+ * parameter 'imagepredictor'
+ */
+int ps_get_image_predictor(PSDoc *psdoc) {
+	const char *predictor;
+
+	predictor = PS_get_parameter(psdoc, "imagepredictor", 0.0);
+	if(predictor == NULL || 0 == strcmp(predictor, "none"))
+		return(PS_PREDICTOR_NONE);
+	if(0 == strcmp(predictor, "sub"))
+		return(PS_PREDICTOR_SUB);
+	if(0 == strcmp(predictor, "up"))
+		return(PS_PREDICTOR_UP);
+	if(0 == strcmp(predictor, "average"))
+		return(PS_PREDICTOR_AVERAGE);
+	if(0 == strcmp(predictor, "paeth"))
+		return(PS_PREDICTOR_PAETH);
+	if(0 == strcmp(predictor, "optimum"))
+		return(PS_PREDICTOR_OPTIMUM);
+	ps_error(psdoc, PS_Warning, _("Unknown image predictor '%s'. Image data will not be predicted."), predictor);
+	return(PS_PREDICTOR_NONE);
+}
+/* }}} */
+
+/* ps_get_binary_data() {{{
+ * Returns true if image and font data is written in binary as set by
+ * the parameter 'binarydata'
+ */
+int ps_get_binary_data(PSDoc *psdoc) {
+	const char *binary;
+
+	binary = PS_get_parameter(psdoc, "binarydata", 0.0);
+	return(binary != NULL && 0 == strcmp(binary, "true"));
+}
+/* }}} */
+
+/* ps_runlength_encode() {{{
+ * Encodes len bytes of data as expected by the RunLengthDecode filter
+ * including the end of data marker. out must have room for
+ * len + len/128 + 2 bytes. Returns the number of bytes in out.
+ */
+size_t ps_runlength_encode(unsigned char *out, const unsigned char *in, size_t len) {
+	unsigned char *outptr = out;
+	size_t i = 0, start, run;
+
+	while(i < len) {
+		run = 1;
+		while(i + run < len && run < 128 && in[i+run] == in[i])
+			run++;
+		if(run > 2) {
+			*outptr++ = 257 - run;
+			*outptr++ = in[i];
+			i += run;
+			continue;
+		}
+		/* Copy bytes literally until the next run of three equal bytes */
+		start = i;
+		while(i < len && i - start < 128) {
+			if(i + 2 < len && in[i] == in[i+1] && in[i] == in[i+2])
+				break;
+			i++;
+		}
+		*outptr++ = i - start - 1;
+		memcpy(outptr, &in[start], i - start);
+		outptr += i - start;
+	}
+	*outptr++ = 128;
+	return(outptr - out);
+}
+/* }}} */
+
+/* ps_probe_image_encoding() {{{
+ * Chooses an encoding for image data by looking at a sample of it.
+ * Data with long runs is run length encoded, which is much cheaper than
+ * deflating it. Data which looks random is not compressed at all and
+ * everything else is deflated or, without zlib, compressed with LZW.
+ * If a predictor is set, the differences of neighbouring bytes are
+ * taken into account, because smooth gradients only compress well after
+ * prediction.
+ */
+int ps_probe_image_encoding(PSDoc *psdoc, const char *data, size_t len) {
+	unsigned char *sample, *rle;
+	size_t samplelen, blocklen, i, rlelen, hist[256], diffhist[256];
+	double entropy, diffentropy, ratio;
+	int blocks, b;
+
+	if(len == 0)
+		return(PS_IMAGEENC_ASCII85);
+	/* The sample consists of up to 16 blocks spread over the data */
+	blocks = 16;
+	blocklen = 4096;
+	if(len <= blocks*blocklen) {
+		blocks = 1;
+		blocklen = len;
+	}
+	samplelen = blocks*blocklen;
+	if(NULL == (sample = psdoc->malloc(psdoc, 2*samplelen + samplelen/128 + 2, _("Allocate memory for image sample."))))
+		return(PS_IMAGEENC_ASCII85);
+	rle = sample + samplelen;
+	for(b=0; b<blocks; b++)
+		memcpy(&sample[b*blocklen], &data[(len - blocklen) / (blocks > 1 ? blocks-1 : 1) * b], blocklen);
+
+	rlelen = ps_runlength_encode(rle, sample, samplelen);
+	memset(hist, 0, sizeof(hist));
+	memset(diffhist, 0, sizeof(diffhist));
+	hist[sample[0]]++;
+	diffhist[sample[0]]++;
+	for(i=1; i<samplelen; i++) {
+		hist[sample[i]]++;
+		diffhist[(unsigned char) (sample[i] - sample[i-1])]++;
+	}
+	entropy = diffentropy = 0.0;
+	for(i=0; i<256; i++) {
+		if(hist[i])
+			entropy -= (double) hist[i] / samplelen * log((double) hist[i] / samplelen);
+		if(diffhist[i])
+			diffentropy -= (double) diffhist[i] / samplelen * log((double) diffhist[i] / samplelen);
+	}
+	entropy /= log(2.0);
+	diffentropy /= log(2.0);
+	/* Level 2 compresses with LZW, which has no predictors */
+	if(diffentropy < entropy && PS_PREDICTOR_NONE != ps_get_image_predictor(psdoc) && psdoc->languagelevel != 2)
+		entropy = diffentropy;
+	psdoc->free(psdoc, sample);
+
+	ratio = (double) rlelen / samplelen;
+	if(ratio < 0.25)
+		return(PS_IMAGEENC_RUNLENGTH);
+	if(entropy > 7.5 && ratio > 0.95)
+		return(PS_IMAGEENC_ASCII85);
+#ifdef HAVE_LIBZ
+	return(PS_IMAGEENC_FLATE);
+#else
+	return(PS_IMAGEENC_LZW);
+#endif
+}
+/* }}} */
+
+/* ps_new_image_chain() {{{
+ * Builds the chain of filters encoding image data as set up in filter.
+ * Binary data is framed for /SubFileDecode. If it is compressed, its
+ * length is not known in advance and the data is collected in
+ * filter->buffer. Streamed data cannot be collected, it is left
+ * unframed and ends with the end of data marker of the compression.
+ */
+static PSFILTER *ps_new_image_chain(PSDoc *psdoc, PSImageFilter *filter) {
+	PSFILTER *last, *f, *p;
+	int compressed, unframed = 0;
+
+	compressed = filter->compression == PS_IMAGECOMP_NONE && (filter->encoding == PS_IMAGEENC_FLATE || filter->encoding == PS_IMAGEENC_RUNLENGTH || filter->encoding == PS_IMAGEENC_LZW);
+	if(filter->binary) {
+		if(compressed && filter->streamed) {
+			last = NULL;
+			unframed = 1;
+		} else if(compressed) {
+			if(NULL == (filter->buffer = str_buffer_new(psdoc, 0)))
+				return NULL;
+			if(NULL == (f = ps_filter_buffer_new(psdoc, filter->buffer)))
+				last = NULL;
+			else if(NULL == (last = ps_filter_subfile_new(psdoc, f, 0)))
+				ps_filter_delete(psdoc, f);
+			if(NULL == last) {
+				str_buffer_delete(psdoc, filter->buffer);
+				filter->buffer = NULL;
+			}
+		} else
+			last = ps_filter_subfile_new(psdoc, NULL, filter->outlength);
+	} else if(filter->encoding == PS_IMAGEENC_HEX)
+		last = ps_filter_asciihex_new(psdoc, 36, 1);
+	else
+		last = ps_filter_ascii85_new(psdoc);
+	filter->framed = filter->binary && !unframed;
+	if(NULL == last && !unframed)
+		return NULL;
+	if(filter->compression == PS_IMAGECOMP_DCT)
+		f = ps_filter_passthrough_new(psdoc, last, "DCTDecode");
+	else if(filter->compression == PS_IMAGECOMP_FLATE)
+		f = ps_filter_predicted_new(psdoc, last, "FlateDecode", filter->colors, filter->bpc, filter->columns);
+	else if(filter->encoding == PS_IMAGEENC_FLATE)
+		f = ps_filter_flate_new(psdoc, last, psdoc->imagecompressionlevel, psdoc->compressionthreads);
+	else if(filter->encoding == PS_IMAGEENC_RUNLENGTH)
+		f = ps_filter_runlength_new(psdoc, last);
+	else if(filter->encoding == PS_IMAGEENC_LZW)
+		f = ps_filter_lzw_new(psdoc, last);
+	else
+		return(last);
+	if(NULL == f) {
+		ps_filter_delete(psdoc, last);
+		if(filter->buffer) {
+			str_buffer_delete(psdoc, filter->buffer);
+			filter->buffer = NULL;
+		}
+		return NULL;
+	}
+	if(filter->predictor != PS_PREDICTOR_NONE) {
+		if(NULL == (p = ps_filter_predictor_new(psdoc, f, filter->predictor, filter->colors, filter->bpc, filter->columns))) {
+			ps_filter_delete(psdoc, f);
+			if(filter->buffer) {
+				str_buffer_delete(psdoc, filter->buffer);
+				filter->buffer = NULL;
+			}
+			return NULL;
+		}
+		f = p;
+	}
+	return(f);
+}
+/* }}} */
+
+/* ps_write_image_samples() {{{
+ * Writes the samples into the chain. If a pixel has more components
+ * than colors, the remaining ones (the alpha channel) are stripped in
+ * small blocks, which saves a copy of the image.
+ */
+static void ps_write_image_samples(PSDoc *psdoc, PSImageFilter *filter) {
+	char buffer[3*1024];
+	const char *dataptr;
+	size_t n, j, pixels;
+	int i;
+
+	if(filter->components == filter->colors) {
+		ps_filter_write(psdoc, filter->chain, filter->data, filter->len);
+		return;
+	}
+	dataptr = filter->data;
+	pixels = filter->len / filter->components;
+	n = 0;
+	for(j=0; j<pixels; j++) {
+		for(i=0; i<filter->colors; i++)
+			buffer[n++] = dataptr[i];
+		dataptr += filter->components;
+		if(n > sizeof(buffer) - filter->colors) {
+			ps_filter_write(psdoc, filter->chain, buffer, n);
+			n = 0;
+		}
+	}
+	if(n > 0)
+		ps_filter_write(psdoc, filter->chain, buffer, n);
+}
+/* }}} */
+
+/* ps_choose_image_encoding() {{{
+ * Sets the encoding and predictor of image data as given by the
+ * parameters. If the encoding is chosen automatically, len bytes of
+ * data are looked at.
+ */
+static void ps_choose_image_encoding(PSDoc *psdoc, PSImageFilter *filter, int compression, const char *data, size_t len) {
+	filter->encoding = ps_get_image_encoding(psdoc);
+	filter->compression = compression;
+	if(compression != PS_IMAGECOMP_NONE) {
+		if(filter->encoding != PS_IMAGEENC_HEX)
+			filter->encoding = PS_IMAGEENC_ASCII85;
+	} else if(filter->encoding == PS_IMAGEENC_AUTO)
+		filter->encoding = ps_probe_image_encoding(psdoc, data, len);
+	/* Level 2 interpreters have no /FlateDecode and no predictors for
+	 * /LZWDecode */
+	if(psdoc->languagelevel == 2 && filter->encoding == PS_IMAGEENC_FLATE)
+		filter->encoding = PS_IMAGEENC_LZW;
+	if(filter->encoding == PS_IMAGEENC_FLATE || (filter->encoding == PS_IMAGEENC_LZW && psdoc->languagelevel != 2))
+		filter->predictor = ps_get_image_predictor(psdoc);
+	else
+		filter->predictor = PS_PREDICTOR_NONE;
+}
+/* }}} */
+
+/* ps_init_image_chain() {{{
+ * Builds the chain of filters for the image data set up in filter
+ */
+static void ps_init_image_chain(PSDoc *psdoc, PSImageFilter *filter) {
+	filter->binary = ps_get_binary_data(psdoc);
+	filter->buffer = NULL;
+	filter->closed = ps_false;
+	filter->chain = ps_new_image_chain(psdoc, filter);
+	if(NULL == filter->chain && filter->compression == PS_IMAGECOMP_NONE && filter->encoding != PS_IMAGEENC_ASCII85) {
+		/* Compression failed, fall back to plain ASCII85 */
+		filter->encoding = PS_IMAGEENC_ASCII85;
+		filter->predictor = PS_PREDICTOR_NONE;
+		filter->chain = ps_new_image_chain(psdoc, filter);
+	}
+}
+/* }}} */
+
+/* ps_init_image_filter() {{{
+ * Sets up the encoding of len bytes of image data with components
+ * values per pixel of which the first colors are written. Each value
+ * has bpc bits and a row has columns pixels. If the data is already
+ * compressed as given by compression, it is only ASCII encoded.
+ * Compressed binary data is encoded right away, because its length is
+ * output before the data. The data must stay valid until it is written
+ * with ps_write_image_data().
+ */
+void ps_init_image_filter(PSDoc *psdoc, PSImageFilter *filter, int colors, int components, int bpc, int columns, int compression, const char *data, size_t len) {
+	ps_choose_image_encoding(psdoc, filter, compression, data, len);
+	filter->colors = colors;
+	filter->components = components;
+	filter->bpc = bpc;
+	filter->columns = columns;
+	filter->data = data;
+	filter->len = len;
+	filter->streamed = ps_false;
+	if(components == colors)
+		filter->outlength = len;
+	else
+		filter->outlength = len / components * colors;
+	ps_init_image_chain(psdoc, filter);
+	if(filter->buffer) {
+		ps_write_image_samples(psdoc, filter);
+		if(0 != ps_filter_close(psdoc, filter->chain))
+			ps_error(psdoc, PS_RuntimeError, _("Could not encode image data."));
+		filter->closed = ps_true;
+		filter->outlength = str_buffer_len(psdoc, filter->buffer);
+	}
+}
+/* }}} */
+
+/* ps_init_image_stream() {{{
+ * Sets up the encoding of len bytes of image data which are passed in
+ * parts with ps_write_image_stream(). Each pixel has colors values of
+ * bpc bits and a row has columns pixels. Data already compressed as
+ * given by compression is only ASCII encoded. Otherwise the encoding is
+ * chosen by looking at the first part of the data in sample.
+ */
+void ps_init_image_stream(PSDoc *psdoc, PSImageFilter *filter, int colors, int bpc, int columns, int compression, const char *sample, size_t samplelen, size_t len) {
+	ps_choose_image_encoding(psdoc, filter, compression, sample, samplelen);
+	filter->colors = colors;
+	filter->components = colors;
+	filter->bpc = bpc;
+	filter->columns = columns;
+	filter->data = NULL;
+	filter->len = len;
+	filter->streamed = ps_true;
+	filter->outlength = len;
+	ps_init_image_chain(psdoc, filter);
+}
+/* }}} */
+
+/* ps_write_image_filter() {{{
+ * Outputs the /Filter and /DecodeParms entries of a dictionary for
+ * decoding image data
+ */
+void ps_write_image_filter(PSDoc *psdoc, PSImageFilter *filter) {
+	if(filter->chain)
+		ps_filter_write_dict(psdoc, filter->chain);
+	else
+		ps_puts(psdoc, "/Filter /ASCII85Decode");
+}
+/* }}} */
+
+/* ps_write_image_datasource() {{{
+ * Outputs code which reads image data from the current file and leaves
+ * the decoding filter on the stack
+ */
+void ps_write_image_datasource(PSDoc *psdoc, PSImageFilter *filter) {
+	if(filter->chain)
+		ps_filter_write_source(psdoc, filter->chain);
+	else
+		ps_puts(psdoc, "currentfile /ASCII85Decode filter");
+}
+/* }}} */
+
+/* ps_begin_image_data() {{{
+ * Outputs op, the code reading the image data. Compressed binary data
+ * collected in advance follows right away. Counted binary data is
+ * enclosed in %%BeginData and %%EndData, so it can be skipped by
+ * document managers.
+ */
+void ps_begin_image_data(PSDoc *psdoc, PSImageFilter *filter, const char *op) {
+	STRBUFFERCHUNK *chunk;
+
+	if(filter->framed)
+		ps_printf(psdoc, "%%%%BeginData: %lu Binary Bytes\n", (unsigned long) (strlen(op) + filter->outlength));
+	ps_puts(psdoc, op);
+	if(filter->buffer) {
+		for(chunk = filter->buffer->first; chunk != NULL; chunk = chunk->next)
+			ps_write(psdoc, chunk->data + chunk->start, chunk->len - chunk->start);
+		str_buffer_delete(psdoc, filter->buffer);
+		filter->buffer = NULL;
+	}
+}
+/* }}} */
+
+/* ps_write_image_stream() {{{
+ * Encodes the next part of streamed image data
+ */
+void ps_write_image_stream(PSDoc *psdoc, PSImageFilter *filter, const char *data, size_t len) {
+	if(filter->chain && !filter->closed)
+		ps_filter_write(psdoc, filter->chain, data, len);
+}
+/* }}} */
+
+/* ps_end_image_data() {{{
+ * Outputs the pending data including the end of data marker and frees
+ * the chain of filters
+ */
+void ps_end_image_data(PSDoc *psdoc, PSImageFilter *filter) {
+	if(filter->chain && !filter->closed) {
+		if(0 != ps_filter_close(psdoc, filter->chain))
+			ps_error(psdoc, PS_RuntimeError, _("Could not encode image data."));
+	} else if(NULL == filter->chain && !filter->binary) {
+		/* Terminate the ASCII85 data at least */
+		ps_ascii85_finish(psdoc, NULL, 0);
+	}
+	if(filter->chain) {
+		ps_filter_delete(psdoc, filter->chain);
+		filter->chain = NULL;
+	}
+	if(filter->framed)
+		ps_puts(psdoc, "\n%%EndData");
+}
+/* }}} */
+
+/* ps_write_image_data() {{{
+ * Outputs op, the code reading the image data, followed by the data
+ * encoded as set up in filter including the end of data marker. Frees
+ * the chain of filters.
+ */
+void ps_write_image_data(PSDoc *psdoc, PSImageFilter *filter, const char *op) {
+	ps_begin_image_data(psdoc, filter, op);
+	if(filter->chain && !filter->closed)
+		ps_write_image_samples(psdoc, filter);
+	ps_end_image_data(psdoc, filter);
 }
 /* }}} */
 
@@ -0,0 +1,281 @@
+/*
+ *    (c) Copyright 2026  Uwe Steinmann.
+ *    All rights reserved.
+ *
+ *    This library is free software; you can redistribute it and/or
+ *    modify it under the terms of the GNU Lesser General Public
+ *    License as published by the Free Software Foundation; either
+ *    version 2 of the License, or (at your option) any later version.
+ *
+ *    This library is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *    Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with this library; if not, write to the
+ *    Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *    Boston, MA 02111-1307, USA.
+ */
+
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include "config.h"
+#ifdef HAVE_PTHREAD
+#include <pthread.h>
+#endif
+#include "ps_intern.h"
+#include "ps_error.h"
+
+/* The writer passes the output of a document to a separate thread which
+ * writes it into the file. The output is copied into a ring of blocks.
+ * If all blocks are in use, the document has to wait until the thread
+ * has written a block. This limits the memory used for output which
+ * has not been written yet.
+ */
+
+#ifdef HAVE_PTHREAD
+
+struct ps_writer_ {
+	FILE *fp;
+	pthread_t thread;
+	pthread_mutex_t mutex;
+	pthread_cond_t queued;   /* Signaled when a block was queued */
+	pthread_cond_t written;  /* Signaled when a block was written */
+	char **blocks;
+	size_t *lens;
+	size_t blocksize;
+	int nblocks;
+	int head;                /* Next block to be written by the thread */
+	int count;               /* Number of blocks queued */
+	int finish;              /* Set if the thread shall terminate */
+	int error;               /* errno of a failed write or 0 */
+	int reported;            /* Set if the error has been reported */
+};
+
+/* ps_writer_thread() {{{
+ * Main loop of the writer thread
+ */
+static void *ps_writer_thread(void *data) {
+	PSWRITER *w = data;
+
+	pthread_mutex_lock(&w->mutex);
+	for(;;) {
+		int i, error = 0;
+		while(w->count == 0 && !w->finish)
+			pthread_cond_wait(&w->queued, &w->mutex);
+		if(w->count == 0)
+			break;
+		i = w->head;
+		pthread_mutex_unlock(&w->mutex);
+
+		/* The block cannot be touched by the document until it has been
+		 * released below. Once an error occured, data is discarded. */
+		if(w->error == 0 && w->lens[i] != fwrite(w->blocks[i], 1, w->lens[i], w->fp))
+			error = errno ? errno : EIO;
+
+		pthread_mutex_lock(&w->mutex);
+		if(error)
+			w->error = error;
+		w->head = (w->head + 1) % w->nblocks;
+		w->count--;
+		pthread_cond_signal(&w->written);
+	}
+	pthread_mutex_unlock(&w->mutex);
+	return(NULL);
+}
+/* }}} */
+
+/* ps_writer_report() {{{
+ * Reports a failed write once
+ */
+static void ps_writer_report(PSDoc *psdoc, PSWRITER *w, int error) {
+	if(!w->reported) {
+		ps_error(psdoc, PS_IOError, _("Could not write to file: %s"), strerror(error));
+		w->reported = 1;
+	}
+}
+/* }}} */
+
+/* ps_writer_free() {{{
+ * Frees the memory of a writer
+ */
+static void ps_writer_free(PSDoc *psdoc, PSWRITER *w) {
+	int i;
+	if(w->blocks) {
+		for(i = 0; i < w->nblocks; i++)
+			if(w->blocks[i])
+				psdoc->free(psdoc, w->blocks[i]);
+		psdoc->free(psdoc, w->blocks);
+	}
+	if(w->lens)
+		psdoc->free(psdoc, w->lens);
+	psdoc->free(psdoc, w);
+}
+/* }}} */
+
+/* ps_writer_new() {{{
+ * Creates a new writer thread for the given file, which uses nblocks
+ * blocks of blocksize bytes each. Returns NULL in case of an error.
+ */
+PSWRITER *ps_writer_new(PSDoc *psdoc, FILE *fp, size_t blocksize, int nblocks) {
+	PSWRITER *w;
+	int i;
+
+	if(nblocks < 2)
+		nblocks = 2;
+	if(NULL == (w = psdoc->malloc(psdoc, sizeof(PSWRITER), _("Allocate memory for writer"))))
+		return NULL;
+	memset(w, 0, sizeof(PSWRITER));
+	w->fp = fp;
+	w->blocksize = blocksize;
+	w->nblocks = nblocks;
+	if(NULL == (w->blocks = psdoc->malloc(psdoc, nblocks*sizeof(char *), _("Allocate memory for writer blocks")))) {
+		ps_writer_free(psdoc, w);
+		return NULL;
+	}
+	memset(w->blocks, 0, nblocks*sizeof(char *));
+	if(NULL == (w->lens = psdoc->malloc(psdoc, nblocks*sizeof(size_t), _("Allocate memory for writer blocks")))) {
+		ps_writer_free(psdoc, w);
+		return NULL;
+	}
+	for(i = 0; i < nblocks; i++) {
+		if(NULL == (w->blocks[i] = psdoc->malloc(psdoc, blocksize, _("Allocate memory for writer block")))) {
+			ps_writer_free(psdoc, w);
+			return NULL;
+		}
+	}
+
+	pthread_mutex_init(&w->mutex, NULL);
+	pthread_cond_init(&w->queued, NULL);
+	pthread_cond_init(&w->written, NULL);
+	if(0 != pthread_create(&w->thread, NULL, ps_writer_thread, w)) {
+		pthread_cond_destroy(&w->written);
+		pthread_cond_destroy(&w->queued);
+		pthread_mutex_destroy(&w->mutex);
+		ps_writer_free(psdoc, w);
+		ps_error(psdoc, PS_RuntimeError, _("Could not start writer thread."));
+		return NULL;
+	}
+	return(w);
+}
+/* }}} */
+
+/* ps_writer_write() {{{
+ * Queues data for being written by the writer thread. Waits if all
+ * blocks are in use. Returns the number of bytes queued which is 0
+ * if writing has failed before.
+ */
+size_t ps_writer_write(PSDoc *psdoc, PSWRITER *w, const char *data, size_t size) {
+	size_t written = 0;
+
+	while(written < size) {
+		size_t n = min(size - written, w->blocksize);
+		int i, error;
+
+		pthread_mutex_lock(&w->mutex);
+		while(w->count == w->nblocks)
+			pthread_cond_wait(&w->written, &w->mutex);
+		i = (w->head + w->count) % w->nblocks;
+		error = w->error;
+		pthread_mutex_unlock(&w->mutex);
+
+		if(error) {
+			ps_writer_report(psdoc, w, error);
+			return(0);
+		}
+
+		memcpy(w->blocks[i], &data[written], n);
+		w->lens[i] = n;
+
+		pthread_mutex_lock(&w->mutex);
+		w->count++;
+		pthread_cond_signal(&w->queued);
+		pthread_mutex_unlock(&w->mutex);
+		written += n;
+	}
+	return(written);
+}
+/* }}} */
+
+/* ps_writer_sync() {{{
+ * Waits until all queued blocks have been written. Returns -1 if
+ * writing has failed.
+ */
+int ps_writer_sync(PSDoc *psdoc, PSWRITER *w) {
+	int error;
+
+	pthread_mutex_lock(&w->mutex);
+	while(w->count > 0)
+		pthread_cond_wait(&w->written, &w->mutex);
+	error = w->error;
+	pthread_mutex_unlock(&w->mutex);
+	if(error) {
+		ps_writer_report(psdoc, w, error);
+		return(-1);
+	}
+	return(0);
+}
+/* }}} */
+
+/* ps_writer_delete() {{{
+ * Writes all queued blocks, terminates the thread and frees the writer.
+ * Returns -1 if writing has failed.
+ */
+int ps_writer_delete(PSDoc *psdoc, PSWRITER *w) {
+	int ret = 0;
+
+	pthread_mutex_lock(&w->mutex);
+	w->finish = 1;
+	pthread_cond_signal(&w->queued);
+	pthread_mutex_unlock(&w->mutex);
+	pthread_join(w->thread, NULL);
+
+	if(w->error) {
+		ps_writer_report(psdoc, w, w->error);
+		ret = -1;
+	}
+	pthread_cond_destroy(&w->written);
+	pthread_cond_destroy(&w->queued);
+	pthread_mutex_destroy(&w->mutex);
+	ps_writer_free(psdoc, w);
+	return(ret);
+}
+/* }}} */
+
+#else
+
+/* Without thread support the writer cannot be created and the
+ * document is written synchronously. */
+
+PSWRITER *ps_writer_new(PSDoc *psdoc, FILE *fp, size_t blocksize, int nblocks) {
+	(void) fp;
+	(void) blocksize;
+	(void) nblocks;
+	ps_error(psdoc, PS_Warning, _("pslib was compiled without thread support. File will be written without writer thread."));
+	return NULL;
+}
+
+size_t ps_writer_write(PSDoc *psdoc, PSWRITER *w, const char *data, size_t size) {
+	(void) psdoc;
+	(void) w;
+	(void) data;
+	(void) size;
+	return(0);
+}
+
+int ps_writer_sync(PSDoc *psdoc, PSWRITER *w) {
+	(void) psdoc;
+	(void) w;
+	return(0);
+}
+
+int ps_writer_delete(PSDoc *psdoc, PSWRITER *w) {
+	(void) psdoc;
+	(void) w;
+	return(0);
+}
+
+#endif /* HAVE_PTHREAD */
+
@@ -0,0 +1,34 @@
+/*
+ *    (c) Copyright 2026  Uwe Steinmann.
+ *    All rights reserved.
+ *
+ *    This library is free software; you can redistribute it and/or
+ *    modify it under the terms of the GNU Lesser General Public
+ *    License as published by the Free Software Foundation; either
+ *    version 2 of the License, or (at your option) any later version.
+ *
+ *    This library is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *    Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with this library; if not, write to the
+ *    Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *    Boston, MA 02111-1307, USA.
+ */
+
+#ifndef __PS_WRITER_H__
+#define __PS_WRITER_H__
+
+/* Default number of blocks queued for the writer thread */
+#define PS_WRITER_BLOCKS 4
+
+typedef struct ps_writer_ PSWRITER;
+
+PSWRITER *ps_writer_new(PSDoc *psdoc, FILE *fp, size_t blocksize, int nblocks);
+size_t ps_writer_write(PSDoc *psdoc, PSWRITER *w, const char *data, size_t size);
+int ps_writer_sync(PSDoc *psdoc, PSWRITER *w);
+int ps_writer_delete(PSDoc *psdoc, PSWRITER *w);
+
+#endif
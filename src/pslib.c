@@ -38,6 +38,7 @@
 #include <unistd.h>
 #endif
 #include <ctype.h>
+#include <errno.h>
 
 #ifdef WIN32
 #include <windows.h>
@@ -80,6 +81,16 @@ ps_writeproc_file(PSDoc *p, void *data, size_t size)
 }
 /* }}} */
 
+/* ps_writeproc_thread() {{{
+ * Output function passing the data to the writer thread
+ */
+static size_t
+ps_writeproc_thread(PSDoc *p, void *data, size_t size)
+{
+	return ps_writer_write(p, p->writer, data, size);
+}
+/* }}} */
+
 /* ps_writeproc_buffer() {{{
  * Default output function for memory
  */
@@ -200,6 +211,8 @@ void _ps_delete_image(PSDoc *psdoc, PSImage *psimage) {
 		psdoc->free(psdoc, psimage->type);
 	if(psimage->data)
 		psdoc->free(psdoc, psimage->data);
+	if(psimage->filename)
+		psdoc->free(psdoc, psimage->filename);
 	if(psimage->name)
 		psdoc->free(psdoc, psimage->name);
 	if(psimage->palette)
@@ -577,6 +590,10 @@ PS_set_info(PSDoc *p, const char *key, const char *val) {
 	  p->BoundingBox = val_buf;
 	} else if (0 == strcmp(key_buf, "Orientation")) {
 	  p->Orientation = val_buf;
+	} else if (0 == strcmp(key_buf, "CreationDate")) {
+		if(p->CreationDate)
+			p->free(p, p->CreationDate);
+		p->CreationDate = val_buf;
 	}
 	p->free(p, key_buf);
 }
@@ -615,8 +632,13 @@ PS_new2(void  (*errorhandler)(PSDoc *p, int type, const char *msg, void *data),
 	p->free = freeproc;
 	p->fp = NULL;
 	p->sb = NULL;
+	p->sbsizehint = 0;
 	p->copies = 1;
 	p->warnings = ps_true;
+	p->builtinprintf = ps_true;
+	p->statcategory = PS_STATS_OTHER;
+	p->pagestats = NULL;
+	p->pagestatssize = 0;
 	p->inputenc = ps_get_inputencoding("ISO-8859-1"); //&inputencoding;
 	p->hdict = NULL;
 	p->hdictfilename = NULL;
@@ -703,6 +725,21 @@ PS_new2(void  (*errorhandler)(PSDoc *p, int type, const char *msg, void *data),
 	p->border_green = 0.0;
 	p->border_blue = 1.0;
 	p->textrendering = -1;
+	p->outbuf = NULL;
+	p->outbufsize = 0;
+	p->outbuflen = 0;
+	p->writerthread = ps_false;
+	p->writer = NULL;
+	p->outputcompression = -1;
+	p->outputcompressionlevel = -1;
+	p->imagecompressionlevel = -1;
+	p->deflater = NULL;
+	p->compressionthreads = 0;
+	p->languagelevel = 0;
+	p->imagecache = NULL;
+	p->imagedatacnt = 0;
+	p->imagestream = NULL;
+	ps_set_output_buffer(p, PS_OUTPUT_BUFFER_SIZE);
 
 	return(p);
 }
@@ -734,21 +771,51 @@ PS_get_opaque(PSDoc *psdoc) {
 
 /* ps_write_ps_comments() {{{ */
 static void ps_write_ps_comments(PSDoc *psdoc) {
-	int i;
+	int i, category;
 	time_t ps_calendar_time;
 	struct tm *ps_local_tm;
-	if(NULL != (psdoc->CreationDate = psdoc->malloc(psdoc, LINEBUFLEN/2, _("Allocate memory for PS header field 'CreationTime'.")))) {
-		ps_calendar_time = time(NULL);
-		if(ps_calendar_time == (time_t)(-1)) {
-			sprintf(psdoc->CreationDate,"%s","20/3/2001 3:30 AM");
+	const char *reproducible, *epoch;
+	char *epochend;
+	long epochvalue;
+	int fixedtime;
+
+	/* The date may have been set with PS_set_info(). Otherwise it is
+	 * taken from SOURCE_DATE_EPOCH as used for reproducible builds or,
+	 * if the output shall be reproducible, set to the epoch. Both are
+	 * in UTC, which does not depend on the time zone of the host. */
+	if(NULL == psdoc->CreationDate) {
+		if(NULL != (psdoc->CreationDate = psdoc->malloc(psdoc, LINEBUFLEN/2, _("Allocate memory for PS header field 'CreationTime'.")))) {
+			reproducible = PS_get_parameter(psdoc, "reproducible", 0.0);
+			epoch = getenv("SOURCE_DATE_EPOCH");
+			fixedtime = 1;
+			if(epoch && *epoch) {
+				errno = 0;
+				epochvalue = strtol(epoch, &epochend, 10);
+				if(errno != 0 || epochend == epoch || *epochend != '\0' || epochvalue < 0) {
+					ps_error(psdoc, PS_Warning, _("SOURCE_DATE_EPOCH '%s' is not a valid number of seconds and will be ignored."), epoch);
+					epoch = NULL;
+				}
+			}
+			if(epoch && *epoch)
+				ps_calendar_time = (time_t) epochvalue;
+			else if(reproducible && 0 == strcmp(reproducible, "true"))
+				ps_calendar_time = 0;
+			else {
+				ps_calendar_time = time(NULL);
+				fixedtime = 0;
+			}
+			if(ps_calendar_time == (time_t)(-1)) {
+				sprintf(psdoc->CreationDate,"%s","20/3/2001 3:30 AM");
+			} else {
+				ps_local_tm = fixedtime ? gmtime(&ps_calendar_time) : localtime(&ps_calendar_time);
+				strftime(psdoc->CreationDate, LINEBUFLEN/2, "%d/%m/%Y %I:%M %p", ps_local_tm);
+			}
 		} else {
-			ps_local_tm = localtime(&ps_calendar_time);
-			strftime(psdoc->CreationDate, LINEBUFLEN/2, "%d/%m/%Y %I:%M %p", ps_local_tm);
+			ps_error(psdoc, PS_MemoryError, _("Cannot allocate memory for PS header field 'CreationTime'."));
 		}
-	} else {
-		ps_error(psdoc, PS_MemoryError, _("Cannot allocate memory for PS header field 'CreationTime'."));
 	}
 
+	category = ps_set_stats_category(psdoc, PS_STATS_COMMENT);
 	ps_printf(psdoc, "%%!PS-Adobe-3.0\n");
 	if(psdoc->Creator)
 		ps_printf(psdoc, "%%%%Creator: %s (%s)\n", psdoc->Creator, "pslib " LIBPS_DOTTED_VERSION);
@@ -761,6 +828,8 @@ static void ps_write_ps_comments(PSDoc *psdoc) {
 		ps_printf(psdoc, "%%%%Title: %s\n", psdoc->Title);
 	if(psdoc->Author)
 		ps_printf(psdoc, "%%%%Author: %s\n", psdoc->Author);
+	if(psdoc->languagelevel)
+		ps_printf(psdoc, "%%%%LanguageLevel: %d\n", psdoc->languagelevel);
 	ps_printf(psdoc, "%%%%PageOrder: Ascend\n");
 	ps_printf(psdoc, "%%%%Pages: (atend)\n");
 	if(psdoc->BoundingBox) {
@@ -792,12 +861,16 @@ static void ps_write_ps_comments(PSDoc *psdoc) {
 			ps_printf(psdoc, "%%%%+ %f %f %f (%s)\n", spotcolor->c1, spotcolor->c2, spotcolor->c3, spotcolor->name);
 	}
 	ps_printf(psdoc, "%%%%EndComments\n");
+	ps_set_stats_category(psdoc, category);
 	psdoc->commentswritten = ps_true;
 }
 /* }}} */
 
 /* ps_write_ps_beginprolog() {{{ */
 static void ps_write_ps_beginprolog(PSDoc *psdoc) {
+	int category;
+	category = ps_set_stats_category(psdoc, PS_STATS_PROLOG);
+	psdoc->index.prolog = ps_tell(psdoc);
 	ps_enter_scope(psdoc, PS_SCOPE_PROLOG);
 	ps_printf(psdoc, "%%%%BeginProlog\n");
 	ps_printf(psdoc, "%%%%BeginResource: definicoes\n");
@@ -1071,13 +1144,17 @@ static void ps_write_ps_beginprolog(PSDoc *psdoc) {
 	if(psdoc->Subject)
 		ps_printf(psdoc, "  /Subject (%s)\n", psdoc->Subject);
 	ps_printf(psdoc, "/DOCINFO pdfmark\n");
+	ps_set_stats_category(psdoc, category);
 	psdoc->beginprologwritten = ps_true;
 }
 /* }}} */
 
 /* ps_write_ps_endprolog() {{{ */
 static void ps_write_ps_endprolog(PSDoc *psdoc) {
+	int category;
+	category = ps_set_stats_category(psdoc, PS_STATS_PROLOG);
 	ps_printf(psdoc, "%%%%EndProlog\n");
+	ps_set_stats_category(psdoc, category);
 	ps_leave_scope(psdoc, PS_SCOPE_PROLOG);
 	psdoc->endprologwritten = ps_true;
 }
@@ -1085,11 +1162,15 @@ static void ps_write_ps_endprolog(PSDoc *psdoc) {
 
 /* ps_write_ps_setup() {{{ */
 static void ps_write_ps_setup(PSDoc *psdoc) {
+	int category;
+	category = ps_set_stats_category(psdoc, PS_STATS_PROLOG);
+	psdoc->index.setup = ps_tell(psdoc);
 	ps_printf(psdoc, "%%%%BeginSetup\n");
 	ps_printf(psdoc, "PslibDict begin\n");
 	if(psdoc->copies > 1)
 		ps_printf(psdoc, "/#copies %d def\n", psdoc->copies);
 	ps_printf(psdoc, "%%%%EndSetup\n");
+	ps_set_stats_category(psdoc, category);
 	psdoc->setupwritten = ps_true;
 }
 /* }}} */
@@ -1244,19 +1325,61 @@ static void ps_setcolor(PSDoc *psdoc, int whichcolor) {
 }
 /* }}} */
 
-/* PS_open_fp() {{{
- * Associates an already open file with the PostScript document created
- * with PS_new().
+/* ps_open_compression() {{{
+ * Starts compressing the output in the given format, which is usually
+ * set by the parameter outputcompression. Must be called after the
+ * writeproc has been set.
  */
-PSLIB_API int PSLIB_CALL
-PS_open_fp(PSDoc *psdoc, FILE *fp) {
+static void
+ps_open_compression(PSDoc *psdoc, int format) {
+	if(format < 0)
+		return;
+	psdoc->deflater = ps_deflater_new(psdoc, psdoc->outputcompressionlevel, format, ps_output_deflated, NULL);
+	if(NULL == psdoc->deflater)
+		ps_error(psdoc, PS_Warning, _("Output will not be compressed."));
+}
+/* }}} */
+
+/* ps_open_digest() {{{
+ * Starts computing checksums of the document and its pages if requested
+ * by the parameter digest.
+ */
+static void
+ps_open_digest(PSDoc *psdoc) {
+	if(psdoc->digesttype == PS_DIGEST_NONE)
+		return;
+	if(NULL == (psdoc->digest = ps_digest_new(psdoc, psdoc->digesttype)) ||
+	   NULL == (psdoc->pagedigest = ps_digest_new(psdoc, psdoc->digesttype))) {
+		ps_error(psdoc, PS_Warning, _("Checksums of the document will not be computed."));
+		if(psdoc->digest) {
+			ps_digest_delete(psdoc, psdoc->digest);
+			psdoc->digest = NULL;
+		}
+	}
+}
+/* }}} */
+
+/* _ps_open_fp() {{{
+ * Associates an already open file with the document and compresses
+ * the output in the given format or not at all if format is -1.
+ */
+static int
+_ps_open_fp(PSDoc *psdoc, FILE *fp, int format) {
 	if(NULL == fp) {
 		ps_error(psdoc, PS_Warning, _("File pointer is NULL. Use PS_open_mem() to create file in memory."));
 		return(-1);
 	}
+	ps_stats_reset(psdoc);
 	psdoc->fp = fp;
 	psdoc->closefp = ps_false;
 	psdoc->writeproc = ps_writeproc_file;
+	if(psdoc->writerthread) {
+		size_t blocksize = max(psdoc->outbufsize, PS_OUTPUT_BUFFER_SIZE);
+		if(NULL != (psdoc->writer = ps_writer_new(psdoc, fp, blocksize, PS_WRITER_BLOCKS)))
+			psdoc->writeproc = ps_writeproc_thread;
+	}
+	ps_open_compression(psdoc, format);
+	ps_open_digest(psdoc);
 	psdoc->page = 0;
 	psdoc->doc_open = ps_true;
 	ps_enter_scope(psdoc, PS_SCOPE_DOCUMENT);
@@ -1265,6 +1388,16 @@ PS_open_fp(PSDoc *psdoc, FILE *fp) {
 }
 /* }}} */
 
+/* PS_open_fp() {{{
+ * Associates an already open file with the PostScript document created
+ * with PS_new().
+ */
+PSLIB_API int PSLIB_CALL
+PS_open_fp(PSDoc *psdoc, FILE *fp) {
+	return(_ps_open_fp(psdoc, fp, psdoc->outputcompression));
+}
+/* }}} */
+
 /* PS_open_file() {{{
  * Associates a file to the PostScript document created with PS_new().
  */
@@ -1276,13 +1409,21 @@ PS_open_file(PSDoc *psdoc, const char *filename) {
 		PS_open_mem(psdoc, NULL);
 		return 0;
 	} else {
-		fp = fopen(filename, "w");
+		size_t len = strlen(filename);
+		int format = psdoc->outputcompression;
+
+		/* Files ending in .gz are compressed unless compression was set.
+		 * The parameter is left as it is for documents opened later. */
+		if(format < 0 && len > 3 && 0 == strcmp(filename+len-3, ".gz"))
+			format = PS_DEFLATE_GZIP;
+
+		fp = fopen(filename, (format < 0) ? "w" : "wb");
 		if(NULL == fp) {
 			ps_error(psdoc, PS_IOError, _("Could not open file '%s'."), filename);
 			return -1;
 		}
 
-		if(0 > PS_open_fp(psdoc, fp)) {
+		if(0 > _ps_open_fp(psdoc, fp, format)) {
 			fclose(fp);
 			return(-1);
 		}
@@ -1298,12 +1439,18 @@ PS_open_file(PSDoc *psdoc, const char *filename) {
  */
 PSLIB_API int PSLIB_CALL
 PS_open_mem(PSDoc *p, size_t (*writeproc)(PSDoc *p, void *data, size_t size)) {
+	ps_stats_reset(p);
 	if (writeproc == NULL) {
-		p->sb = str_buffer_new(p, 1000);
+		if(NULL == (p->sb = str_buffer_new(p, p->sbsizehint))) {
+			ps_error(p, PS_MemoryError, _("Could not allocate memory for document buffer."));
+			return(-1);
+		}
 		p->writeproc = ps_writeproc_buffer;
 	} else {
 		p->writeproc = writeproc;
 	}
+	ps_open_compression(p, p->outputcompression);
+	ps_open_digest(p);
 	p->fp = NULL;
 	p->page = 0;
 	p->doc_open = ps_true;
@@ -1341,6 +1488,40 @@ void _output_bookmarks(PSDoc *psdoc, DLIST *bookmarks) {
 }
 /* }}} */
 
+/* ps_write_index() {{{
+ * Writes the positions of the sections and pages of the document into
+ * a text file. Each line contains the name of a section, the page number
+ * for pages, the offset and the length in bytes.
+ */
+static void ps_write_index(PSDoc *psdoc, const char *filename) {
+	FILE *fp;
+	unsigned int i;
+	unsigned long long end;
+
+	if(NULL == (fp = fopen(filename, "w"))) {
+		ps_error(psdoc, PS_IOError, _("Could not open index file '%s'."), filename);
+		return;
+	}
+	end = psdoc->index.prolog ? psdoc->index.prolog : psdoc->index.trailer;
+	fprintf(fp, "%%!PS-Index 1\n");
+	fprintf(fp, "size %llu\n", psdoc->index.size);
+	fprintf(fp, "comments 0 %llu\n", end);
+	if(psdoc->index.prolog) {
+		end = psdoc->index.setup ? psdoc->index.setup : psdoc->index.trailer;
+		fprintf(fp, "prolog %llu %llu\n", psdoc->index.prolog, end - psdoc->index.prolog);
+	}
+	if(psdoc->index.setup) {
+		end = (psdoc->page > 0 && psdoc->pagestatssize > 0) ? psdoc->pagestats[0].offset : psdoc->index.trailer;
+		fprintf(fp, "setup %llu %llu\n", psdoc->index.setup, end - psdoc->index.setup);
+	}
+	for(i=0; i<psdoc->page && (int) i<psdoc->pagestatssize; i++)
+		fprintf(fp, "page %u %llu %llu\n", i+1, psdoc->pagestats[i].offset, psdoc->pagestats[i].size);
+	fprintf(fp, "trailer %llu %llu\n", psdoc->index.trailer, psdoc->index.size - psdoc->index.trailer);
+	if(fclose(fp) != 0)
+		ps_error(psdoc, PS_IOError, _("Could not write index file '%s'."), filename);
+}
+/* }}} */
+
 /* PS_close() {{{
  * Closes a PostScript document. It closes the actual file only if the
  * document was opened with PS_open_file(). This function does not
@@ -1348,6 +1529,8 @@ void _output_bookmarks(PSDoc *psdoc, DLIST *bookmarks) {
  */
 PSLIB_API void PSLIB_CALL
 PS_close(PSDoc *psdoc) {
+	const char *indexfile;
+
 	/* End page if it is still open */
 	if(psdoc->page_open == ps_true) {
 		ps_error(psdoc, PS_Warning, _("Ending last page of document."));
@@ -1360,6 +1543,8 @@ PS_close(PSDoc *psdoc) {
 
 	/* Write the trailer if the document was not close before */
 	if(psdoc->doc_open == ps_true) {
+		ps_set_stats_category(psdoc, PS_STATS_COMMENT);
+		psdoc->index.trailer = ps_tell(psdoc);
 		ps_printf(psdoc, "%%%%Trailer\n");
 		ps_printf(psdoc, "end\n");
 		if(psdoc->bookmarks->count > 0) {
@@ -1369,7 +1554,42 @@ PS_close(PSDoc *psdoc) {
 		ps_printf(psdoc, "%%%%BoundingBox: %s\n", psdoc->BoundingBox);
 		ps_printf(psdoc, "%%%%Orientation: %s\n", psdoc->Orientation);
 		ps_printf(psdoc, "%%%%EOF");
+		ps_set_stats_category(psdoc, PS_STATS_OTHER);
 		ps_leave_scope(psdoc, PS_SCOPE_DOCUMENT);
+		psdoc->index.size = ps_tell(psdoc);
+		psdoc->index.pages = (int) psdoc->page;
+		indexfile = PS_get_parameter(psdoc, "indexfile", 0.0);
+		if(NULL != indexfile && indexfile[0] != '\0')
+			ps_write_index(psdoc, indexfile);
+	}
+
+	/* Pass the rest of the output buffer to the write procedure */
+	if(psdoc->writeproc)
+		ps_flush(psdoc);
+	/* Terminate the compressed stream */
+	if(psdoc->deflater) {
+		ps_deflater_finish(psdoc, psdoc->deflater);
+		ps_deflater_delete(psdoc, psdoc->deflater);
+		psdoc->deflater = NULL;
+	}
+	/* Everything has been passed to the write procedure */
+	if(psdoc->digest) {
+		psdoc->docdigestsize = ps_digest_final(psdoc->digest, psdoc->docdigest);
+		ps_digest_delete(psdoc, psdoc->digest);
+		psdoc->digest = NULL;
+	}
+	if(psdoc->pagedigest) {
+		ps_digest_delete(psdoc, psdoc->pagedigest);
+		psdoc->pagedigest = NULL;
+	}
+	if(psdoc->sb)
+		str_buffer_seal(psdoc->sb);
+
+	/* Wait until the writer thread has written everything */
+	if(psdoc->writer) {
+		ps_writer_delete(psdoc, psdoc->writer);
+		psdoc->writer = NULL;
+		psdoc->writeproc = ps_writeproc_file;
 	}
 
 	/* FIXME: Need to free the linked lists parameters, categories and values */
@@ -1402,6 +1622,26 @@ PS_delete(PSDoc *psdoc) {
 	if(psdoc->sb)
 		str_buffer_delete(psdoc, psdoc->sb);
 
+	if(psdoc->outbuf) {
+		psdoc->free(psdoc, psdoc->outbuf);
+		psdoc->outbuf = NULL;
+	}
+
+	if(psdoc->writer) {
+		ps_writer_delete(psdoc, psdoc->writer);
+		psdoc->writer = NULL;
+	}
+
+	if(psdoc->pagestats) {
+		psdoc->free(psdoc, psdoc->pagestats);
+		psdoc->pagestats = NULL;
+	}
+
+	if(psdoc->pagedigests) {
+		psdoc->free(psdoc, psdoc->pagedigests);
+		psdoc->pagedigests = NULL;
+	}
+
 	/* Free the memory */
 	ps_del_resources(psdoc);
 	ps_del_parameters(psdoc);
@@ -1453,6 +1693,15 @@ PS_delete(PSDoc *psdoc) {
 	psdoc->free(psdoc, psdoc->fonts);
 
 	/* Freeing image resources */
+	if(psdoc->imagestream) {
+		if(psdoc->imagestream->filter.chain)
+			ps_filter_delete(psdoc, psdoc->imagestream->filter.chain);
+		if(psdoc->imagestream->filter.buffer)
+			str_buffer_delete(psdoc, psdoc->imagestream->filter.buffer);
+		psdoc->free(psdoc, psdoc->imagestream);
+	}
+	if(psdoc->imagecache)
+		ght_finalize(psdoc->imagecache);
 	i = 0;
 	while(i < psdoc->imagecnt) {
 		if(psdoc->images[i]) {
@@ -1606,6 +1855,42 @@ PS_set_parameter(PSDoc *psdoc, const char *name, const char *value) {
 		if(psdoc->hdictfilename)
 			psdoc->free(psdoc, psdoc->hdictfilename);
 		psdoc->hdictfilename = ps_strdup(psdoc, value);
+	} else if(strcmp(name, "outputcompression") == 0) {
+		if(strcmp(value, "none") == 0) {
+			psdoc->outputcompression = -1;
+		} else if(strcmp(value, "gzip") == 0) {
+			psdoc->outputcompression = PS_DEFLATE_GZIP;
+		} else if(strcmp(value, "deflate") == 0) {
+			psdoc->outputcompression = PS_DEFLATE_ZLIB;
+		} else {
+			ps_error(psdoc, PS_Warning, _("Output compression '%s' is unknown, must be 'none', 'gzip' or 'deflate'."), value);
+		}
+	} else if(strcmp(name, "writerthread") == 0) {
+		if(strcmp(value, "true") == 0) {
+			psdoc->writerthread = ps_true;
+		} else {
+			psdoc->writerthread = ps_false;
+		}
+	} else if(strcmp(name, "digest") == 0) {
+		if(psdoc->doc_open == ps_true) {
+			ps_error(psdoc, PS_Warning, _("Parameter '%s' must be set before the document is opened."), name);
+		} else if(strcmp(value, "none") == 0) {
+			psdoc->digesttype = PS_DIGEST_NONE;
+		} else if(strcmp(value, "crc32") == 0) {
+			psdoc->digesttype = PS_DIGEST_CRC32;
+		} else if(strcmp(value, "sha256") == 0) {
+			psdoc->digesttype = PS_DIGEST_SHA256;
+		} else {
+			ps_error(psdoc, PS_Warning, _("Digest '%s' is unknown, must be 'none', 'crc32' or 'sha256'."), value);
+		}
+	} else if(strcmp(name, "numberformat") == 0) {
+		if(strcmp(value, "builtin") == 0) {
+			psdoc->builtinprintf = ps_true;
+		} else if(strcmp(value, "libc") == 0) {
+			psdoc->builtinprintf = ps_false;
+		} else {
+			ps_error(psdoc, PS_Warning, _("Number format '%s' is unknown, must be 'builtin' or 'libc'."), value);
+		}
 	} else if(strcmp(name, "inputencoding") == 0) {
 		ENCODING *enc;
 		if(NULL != (enc = ps_get_inputencoding(value))) {
@@ -1687,6 +1972,17 @@ PS_get_parameter(PSDoc *psdoc, const char *name, float modifier) {
 		return(psfont->metrics->codingscheme);
 	} else if(strcmp(name, "dottedversion") == 0) {
 		return(LIBPS_DOTTED_VERSION);
+	} else if(strcmp(name, "numberformat") == 0) {
+		return(psdoc->builtinprintf ? "builtin" : "libc");
+	} else if(strcmp(name, "digest") == 0) {
+		switch(psdoc->digesttype) {
+			case PS_DIGEST_CRC32:
+				return("crc32");
+			case PS_DIGEST_SHA256:
+				return("sha256");
+			default:
+				return("none");
+		}
 	} else if(strcmp(name, "scope") == 0) {
 		switch(ps_current_scope(psdoc)) {
 			case PS_SCOPE_OBJECT:
@@ -1709,6 +2005,8 @@ PS_get_parameter(PSDoc *psdoc, const char *name, float modifier) {
 				return("font");
 			case PS_SCOPE_GLYPH:
 				return("glyph");
+			case PS_SCOPE_IMAGE:
+				return("image");
 		}
 	} else {
 		for(param = dlst_first(psdoc->parameters); param != NULL; param = dlst_next(param)) {
@@ -1747,6 +2045,46 @@ PS_set_value(PSDoc *psdoc, const char *name, float value) {
 		psdoc->tstates[psdoc->tstate].cy = value;
 	} else if(strcmp(name, "textrendering") == 0) {
 		psdoc->textrendering = (int) value;
+	} else if(strcmp(name, "outputbuffersize") == 0) {
+		if(value < 0.0) {
+			ps_error(psdoc, PS_Warning, _("Size of output buffer must not be negative."));
+			return;
+		}
+		ps_set_output_buffer(psdoc, (size_t) value);
+	} else if(strcmp(name, "outputcompressionlevel") == 0) {
+		if(value < 0.0 || value > 9.0) {
+			ps_error(psdoc, PS_Warning, _("Compression level must be between 0 and 9."));
+			return;
+		}
+		psdoc->outputcompressionlevel = (int) value;
+	} else if(strcmp(name, "imagecompressionlevel") == 0) {
+		if(value < 0.0 || value > 9.0) {
+			ps_error(psdoc, PS_Warning, _("Compression level must be between 0 and 9."));
+			return;
+		}
+		psdoc->imagecompressionlevel = (int) value;
+	} else if(strcmp(name, "compressionthreads") == 0) {
+		if(value < 0.0) {
+			ps_error(psdoc, PS_Warning, _("Number of compression threads must not be negative."));
+			return;
+		}
+		if(value > PS_DEFLATE_MAXTHREADS) {
+			ps_error(psdoc, PS_Warning, _("Number of compression threads is limited to %d."), PS_DEFLATE_MAXTHREADS);
+			value = PS_DEFLATE_MAXTHREADS;
+		}
+		psdoc->compressionthreads = (int) value;
+	} else if(strcmp(name, "languagelevel") == 0) {
+		if(value != 2.0 && value != 3.0) {
+			ps_error(psdoc, PS_Warning, _("Language level must be 2 or 3."));
+			return;
+		}
+		psdoc->languagelevel = (int) value;
+	} else if(strcmp(name, "memorybuffersize") == 0) {
+		if(value < 0.0) {
+			ps_error(psdoc, PS_Warning, _("Size of memory buffer must not be negative."));
+			return;
+		}
+		psdoc->sbsizehint = (size_t) value;
 	} else {
 		/* Check if value exists */
 		for(parameter = dlst_first(psdoc->values); parameter != NULL; parameter = dlst_next(parameter)) {
@@ -1896,6 +2234,18 @@ PS_get_value(PSDoc *psdoc, const char *name, float modifier) {
 		return(psdoc->tstates[psdoc->tstate].ty);
 	} else if(strcmp(name, "textrendering") == 0) {
 		return((float) psdoc->textrendering);
+	} else if(strcmp(name, "outputbuffersize") == 0) {
+		return((float) psdoc->outbufsize);
+	} else if(strcmp(name, "memorybuffersize") == 0) {
+		return((float) psdoc->sbsizehint);
+	} else if(strcmp(name, "outputcompressionlevel") == 0) {
+		return((float) psdoc->outputcompressionlevel);
+	} else if(strcmp(name, "imagecompressionlevel") == 0) {
+		return((float) psdoc->imagecompressionlevel);
+	} else if(strcmp(name, "compressionthreads") == 0) {
+		return((float) psdoc->compressionthreads);
+	} else if(strcmp(name, "languagelevel") == 0) {
+		return((float) (psdoc->languagelevel ? psdoc->languagelevel : 3));
 	} else if(strcmp(name, "wordspacing") == 0) {
 		ADOBEINFO *ai = NULL;
 		if(psdoc->font != NULL && psdoc->font->metrics != NULL)
@@ -1996,6 +2346,8 @@ PS_begin_page(PSDoc *psdoc, float width, float height) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
+	ps_set_stats_category(psdoc, PS_STATS_OTHER);
 //	if(psdoc->commentswritten == ps_false) {
 	if(psdoc->page == 0) {
 		/* Do not overwrite the BoundingBox if it has been set before */
@@ -2025,7 +2377,9 @@ PS_begin_page(PSDoc *psdoc, float width, float height) {
 	}
 
 	(psdoc->page)++;
-	ps_printf(psdoc, "\n%%%%Page: %i %i\n", psdoc->page, psdoc->page);
+	ps_putc(psdoc, '\n');
+	ps_stats_begin_page(psdoc);
+	ps_printf(psdoc, "%%%%Page: %i %i\n", psdoc->page, psdoc->page);
 	ps_printf(psdoc, "%%%%PageBoundingBox: 0 0 %d %d\n", (int) width, (int) height);
 	ps_printf(psdoc, "%%%%BeginPageSetup\n");
 	ps_printf(psdoc, "[ /CropBox [0 0 %.2f %.2f] /PAGE pdfmark\n", width, height);
@@ -2048,6 +2402,10 @@ PS_begin_page(PSDoc *psdoc, float width, float height) {
 	psdoc->tstates[psdoc->tstate].cx = 100.0;
 	psdoc->tstates[psdoc->tstate].cy = 100.0;
 	psdoc->page_open = ps_true;
+	/* Everything drawn on the page which is not written by one of the
+	 * functions for text, images, fonts or annotations is accounted to
+	 * paths */
+	ps_set_stats_category(psdoc, PS_STATS_PATH);
 	ps_enter_scope(psdoc, PS_SCOPE_PAGE);
 }
 /* }}} */
@@ -2061,6 +2419,8 @@ PS_end_page(PSDoc *psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
+	ps_set_stats_category(psdoc, PS_STATS_OTHER);
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page' scope."), __FUNCTION__);
 		return;
@@ -2075,6 +2435,11 @@ PS_end_page(PSDoc *psdoc) {
 	ps_printf(psdoc, "%i PslibPageEndHook\n", psdoc->page);
 	ps_printf(psdoc, "restore\n");
 	ps_printf(psdoc, "showpage\n");
+	ps_stats_end_page(psdoc);
+	ps_flush(psdoc);
+	/* Everything up to here can be retrieved with PS_drain_buffer_chunks() */
+	if(psdoc->sb)
+		str_buffer_seal(psdoc->sb);
 	psdoc->page_open = ps_false;
 	/* Set current font to NULL in order to enforce calling PS_set_font().
 	 * PS_set_font() is needed because each page in encapsulated in save/restore
@@ -2172,11 +2537,11 @@ static void ps_render_text(PSDoc *psdoc, const char *text) {
 }
 /* }}} */
 
-/* PS_show2() {{{
+/* _ps_show2() {{{
  * Output text at current position. Do not print more the xlen characters.
  */
-PSLIB_API void PSLIB_CALL
-PS_show2(PSDoc *psdoc, const char *text, int xlen) {
+static void
+_ps_show2(PSDoc *psdoc, const char *text, int xlen) {
 	int kernonoff;
 	int ligonoff;
 	char ligdischar;
@@ -2186,8 +2551,9 @@ PS_show2(PSDoc *psdoc, const char *text, int xlen) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
-		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
+		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), "PS_show2");
 		return;
 	}
 	if(NULL == text) {
@@ -2363,6 +2729,21 @@ PS_show2(PSDoc *psdoc, const char *text, int xlen) {
 }
 /* }}} */
 
+/* PS_show2() {{{
+ * Calls _ps_show2() and measures the time spent in it
+ */
+PSLIB_API void PSLIB_CALL
+PS_show2(PSDoc *psdoc, const char *text, int xlen) {
+	int category;
+
+	ps_stats_start_timer(psdoc, PS_STATS_TIME_TEXT);
+	category = ps_set_stats_category(psdoc, PS_STATS_TEXT);
+	_ps_show2(psdoc, text, xlen);
+	ps_set_stats_category(psdoc, category);
+	ps_stats_stop_timer(psdoc, PS_STATS_TIME_TEXT);
+}
+/* }}} */
+
 /* PS_show() {{{
  * Output null terminated string
  */
@@ -2393,6 +2774,7 @@ PS_continue_text2(PSDoc *psdoc, const char *text, int len) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
 		return;
@@ -2414,14 +2796,14 @@ PS_continue_text2(PSDoc *psdoc, const char *text, int len) {
 
 //#define MAX_CHARS_IN_LINE 1024
 
-/* PS_show_boxed() {{{
+/* _ps_show_boxed() {{{
  * Outputs text in a box with given dimensions. The text is justified
  * as specified in hmode. This function uses several parameters and values
  * to format the output. The return value is the number of characters that
  * could not be written.
  */
-PSLIB_API int PSLIB_CALL
-PS_show_boxed(PSDoc *psdoc, const char *text, float left, float bottom, float width, float height, const char *hmode, const char *feature) {
+static int
+_ps_show_boxed(PSDoc *psdoc, const char *text, float left, float bottom, float width, float height, const char *hmode, const char *feature) {
 	char *str = NULL;
 	char *textcopy = NULL;
 	char *linebuf = NULL;
@@ -2449,7 +2831,7 @@ PS_show_boxed(PSDoc *psdoc, const char *text, float left, float bottom, float wi
 	}
 
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
-		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
+		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), "PS_show_boxed");
 		return 0;
 	}
 
@@ -2899,6 +3281,20 @@ PS_show_boxed(PSDoc *psdoc, const char *text, float left, float bottom, float wi
 }
 /* }}} */
 
+/* PS_show_boxed() {{{
+ * Calls _ps_show_boxed() and measures the time spent in it
+ */
+PSLIB_API int PSLIB_CALL
+PS_show_boxed(PSDoc *psdoc, const char *text, float left, float bottom, float width, float height, const char *hmode, const char *feature) {
+	int ret;
+
+	ps_stats_start_timer(psdoc, PS_STATS_TIME_TEXT);
+	ret = _ps_show_boxed(psdoc, text, left, bottom, width, height, hmode, feature);
+	ps_stats_stop_timer(psdoc, PS_STATS_TIME_TEXT);
+	return(ret);
+}
+/* }}} */
+
 /* PS_moveto() {{{
  * Moves the current position (cursor) to the passed position
  * This function starts a new path if it is called in page-scope,
@@ -2911,6 +3307,7 @@ PS_moveto(PSDoc *psdoc, float x, float y) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PATH | PS_SCOPE_PAGE | PS_SCOPE_TEMPLATE | PS_SCOPE_PATTERN | PS_SCOPE_GLYPH)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'path', 'template', 'pattern', 'glyph' or 'page' scope."), __FUNCTION__);
 		return;
@@ -2946,6 +3343,7 @@ PS_show_xy2(PSDoc *psdoc, const char *text, int xlen, float x, float y) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
 		return;
@@ -2967,6 +3365,7 @@ PS_lineto(PSDoc *psdoc, float x, float y) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PATH)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'path' scope."), __FUNCTION__);
 		return;
@@ -2986,6 +3385,7 @@ PS_set_text_pos(PSDoc *psdoc, float x, float y) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
 		return;
@@ -3006,6 +3406,7 @@ PS_setlinewidth(PSDoc *p, float width) {
 		ps_error(p, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(p, PS_SCOPE_PAGE | PS_SCOPE_TEMPLATE | PS_SCOPE_PATTERN | PS_SCOPE_GLYPH)) {
 		ps_error(p, PS_RuntimeError, _("%s must be called within 'page', 'template', 'glyph', or 'pattern' scope."), __FUNCTION__);
 		return;
@@ -3023,6 +3424,7 @@ PS_setlinecap(PSDoc *p, int type) {
 		ps_error(p, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(p, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(p, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
 		return;
@@ -3044,6 +3446,7 @@ PS_setlinejoin(PSDoc *p, int type) {
 		ps_error(p, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(p, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(p, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
 		return;
@@ -3064,6 +3467,7 @@ PS_setmiterlimit(PSDoc *p, float value) {
 		ps_error(p, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(p, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(p, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
 		return;
@@ -3084,6 +3488,7 @@ PS_setflat(PSDoc *p, float value) {
 		ps_error(p, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(p, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(p, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
 		return;
@@ -3105,6 +3510,7 @@ PS_setdash(PSDoc *p, float on, float off) {
 		ps_error(p, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(p, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(p, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
 		return;
@@ -3130,6 +3536,7 @@ PS_setpolydash(PSDoc *p, float *arr, int length) {
 		ps_error(p, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(p, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(p, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
 		return;
@@ -3157,6 +3564,7 @@ PS_setmatrix(PSDoc *p, float a, float b, float c, float d, float e, float f) {
 		ps_error(p, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(p, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(p, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
 		return;
@@ -3173,6 +3581,7 @@ PS_setoverprintmode(PSDoc *p, int mode) {
 		ps_error(p, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(p, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(p, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
 		return;
@@ -3194,6 +3603,7 @@ PS_setsmoothness(PSDoc *p, float smoothness) {
 		ps_error(p, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(p, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(p, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
 		return;
@@ -3216,6 +3626,7 @@ PS_rect(PSDoc *psdoc, float x, float y, float width, float height) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PATH | PS_SCOPE_PAGE | PS_SCOPE_TEMPLATE | PS_SCOPE_PATTERN | PS_SCOPE_GLYPH)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'path', 'template', 'pattern', 'glyph' or 'page' scope."), __FUNCTION__);
 		return;
@@ -3243,6 +3654,7 @@ PS_circle(PSDoc *psdoc, float x, float y, float radius) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PATH | PS_SCOPE_PAGE | PS_SCOPE_TEMPLATE | PS_SCOPE_PATTERN | PS_SCOPE_GLYPH)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'path', 'template', 'pattern', 'glyph' or 'page' scope."), __FUNCTION__);
 		return;
@@ -3272,6 +3684,7 @@ PS_arc(PSDoc *psdoc, float x, float y, float radius, float alpha, float beta) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PATH | PS_SCOPE_PAGE | PS_SCOPE_TEMPLATE | PS_SCOPE_PATTERN)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'path', 'template', 'pattern' or 'page' scope."), __FUNCTION__);
 		return;
@@ -3301,6 +3714,7 @@ PS_arcn(PSDoc *psdoc, float x, float y, float radius, float alpha, float beta) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PATH | PS_SCOPE_PAGE | PS_SCOPE_TEMPLATE | PS_SCOPE_PATTERN)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'path', 'template', 'pattern' or 'page' scope."), __FUNCTION__);
 		return;
@@ -3330,6 +3744,7 @@ PS_curveto(PSDoc *psdoc, float x1, float y1, float x2, float y2, float x3, float
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PATH)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'path' scope."), __FUNCTION__);
 		return;
@@ -3349,6 +3764,7 @@ PS_setgray(PSDoc *psdoc, float gray) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page' scope."), __FUNCTION__);
 		return;
@@ -3366,6 +3782,7 @@ PS_clip(PSDoc *psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PATH)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'path' scope."), __FUNCTION__);
 		return;
@@ -3384,6 +3801,7 @@ PS_closepath(PSDoc *psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PATH)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'path' scope."), __FUNCTION__);
 		return;
@@ -3401,6 +3819,7 @@ PS_closepath_stroke(PSDoc *psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PATH)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'path' scope."), __FUNCTION__);
 		return;
@@ -3421,6 +3840,7 @@ PS_fill_stroke(PSDoc *psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PATH)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'path' scope."), __FUNCTION__);
 		return;
@@ -3443,6 +3863,7 @@ PS_stroke(PSDoc *psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PATH)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'path' scope."), __FUNCTION__);
 		return;
@@ -3462,6 +3883,7 @@ PS_fill(PSDoc *psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PATH)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'path' scope."), __FUNCTION__);
 		return;
@@ -3482,6 +3904,7 @@ PS_shfill(PSDoc *psdoc, int shading) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	psshading = _ps_get_shading(psdoc, shading);
 	if(NULL == psshading) {
 		ps_error(psdoc, PS_RuntimeError, _("PSShading is null."));
@@ -3506,6 +3929,7 @@ PS_save(PSDoc *psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
 		return;
@@ -3533,6 +3957,7 @@ PS_restore(PSDoc *psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
 		return;
@@ -3559,6 +3984,7 @@ PS_create_gstate(PSDoc *psdoc, const char *optlist) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return(0);
 	}
+
 	if(NULL != optlist && optlist[0] != '\0') {
 		ps_error(psdoc, PS_RuntimeError, _("Option list may not be empty."));
 		return(0);
@@ -3599,6 +4025,7 @@ PS_set_gstate(PSDoc *psdoc, int gstate) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	psgstate = _ps_get_gstate(psdoc, gstate);
 	if(NULL == psgstate) {
 		ps_error(psdoc, PS_RuntimeError, _("PSGState is null."));
@@ -3658,6 +4085,7 @@ PS_rotate(PSDoc *psdoc, float x) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
 		return;
@@ -3676,6 +4104,7 @@ PS_translate(PSDoc *psdoc, float x, float y) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
 		return;
@@ -3694,6 +4123,7 @@ PS_skew(PSDoc *psdoc, float alpha, float beta) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
 		return;
@@ -3711,6 +4141,7 @@ PS_concat(PSDoc *psdoc, float a, float b, float c, float d, float e, float f) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
 		return;
@@ -3728,6 +4159,7 @@ PS_scale(PSDoc *psdoc, float x, float y) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
 		return;
@@ -3747,6 +4179,7 @@ PS_setcolor(PSDoc *psdoc, const char *type, const char *colorspace, float c1, fl
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	/* FIXME: Maybe called in pattern only if painttype = 1 */
 	if(!ps_check_scope(psdoc, PS_SCOPE_PROLOG|PS_SCOPE_DOCUMENT|PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'prolog', 'document', 'page', 'pattern', or 'template' scope."), __FUNCTION__);
@@ -3956,12 +4389,12 @@ PS_makespotcolor(PSDoc *psdoc, const char *name, int reserved) {
 }
 /* }}} */
 
-/* PS_findfont() {{{
+/* _ps_findfont() {{{
  * Finds a font. Actually tries to load an afm file for the given fontname.
  * Resource of the font must be freed with PS_delete_font()
  */
-PSLIB_API int PSLIB_CALL
-PS_findfont(PSDoc *psdoc, const char *fontname, const char *encoding, int embed) {
+static int
+_ps_findfont(PSDoc *psdoc, const char *fontname, const char *encoding, int embed) {
 	PSFont *psfont;
 	ADOBEFONTMETRIC *metrics;
 	char *filename;
@@ -3971,6 +4404,7 @@ PS_findfont(PSDoc *psdoc, const char *fontname, const char *encoding, int embed)
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return(0);
 	}
+
 	/* Check if this function does any output. If it does and we are
 	 * beyond the header already, then issue
 	 * a warning, because if the output goes between pages it will be lost
@@ -3981,11 +4415,11 @@ PS_findfont(PSDoc *psdoc, const char *fontname, const char *encoding, int embed)
 		 * scope.
 		 */
 		if(ps_check_scope(psdoc, PS_SCOPE_DOCUMENT)) {
-			ps_error(psdoc, PS_Warning, _("Calling %s between pages is likely to cause problems when viewing the document. Call in within a page or in the prolog."), __FUNCTION__);
+			ps_error(psdoc, PS_Warning, _("Calling %s between pages is likely to cause problems when viewing the document. Call in within a page or in the prolog."), "PS_findfont");
 		}
 	}
 	if(!ps_check_scope(psdoc, PS_SCOPE_PROLOG|PS_SCOPE_PAGE|PS_SCOPE_DOCUMENT|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
-		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'prolog', 'document', 'page', 'pattern', or 'template' scope."), __FUNCTION__);
+		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'prolog', 'document', 'page', 'pattern', or 'template' scope."), "PS_findfont");
 		return(0);
 	}
 
@@ -4116,8 +4550,8 @@ PS_findfont(PSDoc *psdoc, const char *fontname, const char *encoding, int embed)
 				int ts = fread(bb, 1, fsize, fp);
 				if ((bb[0] == (unsigned char) 128) && (bb[1]) == (unsigned char) 1) {
 					unsigned int ulen, j;
-					unsigned int posi,cxxc=0;
-					char linebuf[80];
+					PSFILTER *fontfilter;
+					unsigned int posi;
 
 					/* If the header is not written, because we are before
 					 * the first page, then output the header first.
@@ -4143,36 +4577,34 @@ PS_findfont(PSDoc *psdoc, const char *fontname, const char *encoding, int embed)
           if (ulen > fsize)
 						ulen = fsize-7;
 					posi += 6;
-					cxxc=0;
-					for (j = 0; j < ulen; j++) {
-						unsigned char u=bb[posi];
-						linebuf[cxxc]=((u >> 4) & 15) + '0';
-						if(u>0x9f) linebuf[cxxc]+='a'-':';
-						++cxxc;
-						u&=15; linebuf[cxxc]=u + '0';
-						if(u>0x9) linebuf[cxxc]+='a'-':';
-						++posi;
-						++cxxc;
-						if (cxxc > 72) {
-							linebuf[cxxc++]='\n';
-							linebuf[cxxc++]=0;
-							ps_printf(psdoc, "%s", linebuf);
-							cxxc = 0;
-						}
+					/* The binary section is output in hex in lines of 37
+					 * bytes. A full last line is followed by an empty line.
+					 * In binary mode it is copied, eexec recognizes binary
+					 * data by itself. */
+					if(ps_get_binary_data(psdoc)) {
+						fontfilter = ps_filter_passthrough_new(psdoc, NULL, NULL);
+					} else {
+						fontfilter = ps_filter_asciihex_new(psdoc, 37, 0);
+					}
+					if(NULL != fontfilter) {
+						ps_filter_write(psdoc, fontfilter, &bb[posi], ulen);
+						ps_filter_close(psdoc, fontfilter);
+						ps_filter_delete(psdoc, fontfilter);
 					}
-					linebuf[cxxc]=0;
-					ps_printf(psdoc, "%s\n", linebuf);
+					if(!ps_get_binary_data(psdoc) && ulen > 0 && ulen % 37 == 0)
+						ps_putc(psdoc, '\n');
+					ps_putc(psdoc, '\n');
+					posi += ulen;
 					posi += 6;
 					for (j = posi; j < fsize; j++) {
 						if ((bb[j] == (unsigned char) 128) && (bb[j+1] == (unsigned char) 3))
 							break;
 						if(bb[j]=='\r')
-							ps_printf(psdoc, "\n");
-						else
-							ps_printf(psdoc, "%c", bb[j]);
+							ps_putc(psdoc, '\n');
+						else if(bb[j] != '\0')
+							ps_putc(psdoc, bb[j]);
 					}
 					ps_printf(psdoc, "\n");
-					cxxc = 0;
 					ps_printf(psdoc, "%%EndFont\n");
 				} else {
 					ps_error(psdoc, PS_Warning, _("Outline of font '%s' does not start with 0x80 0x01"), fontname);
@@ -4190,6 +4622,22 @@ PS_findfont(PSDoc *psdoc, const char *fontname, const char *encoding, int embed)
 }
 /* }}} */
 
+/* PS_findfont() {{{
+ * Calls _ps_findfont() and measures the time spent in it
+ */
+PSLIB_API int PSLIB_CALL
+PS_findfont(PSDoc *psdoc, const char *fontname, const char *encoding, int embed) {
+	int fontid, category;
+
+	ps_stats_start_timer(psdoc, PS_STATS_TIME_FONT);
+	category = ps_set_stats_category(psdoc, PS_STATS_FONT);
+	fontid = _ps_findfont(psdoc, fontname, encoding, embed);
+	ps_set_stats_category(psdoc, category);
+	ps_stats_stop_timer(psdoc, PS_STATS_TIME_FONT);
+	return(fontid);
+}
+/* }}} */
+
 /* PS_load_font() {{{
  * Finds a font. Actually tries to load an afm file for the given fontname.
  * Resource of the font must be freed with PS_delete_font()
@@ -4215,13 +4663,13 @@ PS_load_font(PSDoc *psdoc, const char *fontname, int len, const char *encoding,
 }
 /* }}} */
 
-/* PS_string_geometry() {{{
+/* _ps_string_geometry() {{{
  * Calculates the width of string using the given font.
  * If dimension is not NULL it will be filled with the width, descender and
  * ascender.
  */
-PSLIB_API float PSLIB_CALL
-PS_string_geometry(PSDoc *psdoc, const char *text, int xlen, int fontid, float size, float *dimension) {
+static float
+_ps_string_geometry(PSDoc *psdoc, const char *text, int xlen, int fontid, float size, float *dimension) {
 	PSFont *psfont;
 	float width = 0.0, ascender = 0.0, descender = 0.0, charspacing;
 	int i, len;
@@ -4332,6 +4780,20 @@ PS_string_geometry(PSDoc *psdoc, const char *text, int xlen, int fontid, float s
 }
 /* }}} */
 
+/* PS_string_geometry() {{{
+ * Calls _ps_string_geometry() and measures the time spent in it
+ */
+PSLIB_API float PSLIB_CALL
+PS_string_geometry(PSDoc *psdoc, const char *text, int xlen, int fontid, float size, float *dimension) {
+	float width;
+
+	ps_stats_start_timer(psdoc, PS_STATS_TIME_TEXT);
+	width = _ps_string_geometry(psdoc, text, xlen, fontid, size, dimension);
+	ps_stats_stop_timer(psdoc, PS_STATS_TIME_TEXT);
+	return(width);
+}
+/* }}} */
+
 /* PS_stringwidth2() {{{
  * Calculates the width of string using the current font.
  */
@@ -4365,10 +4827,13 @@ PS_deletefont(PSDoc *psdoc, int fontid) {
 PSLIB_API void PSLIB_CALL
 PS_setfont(PSDoc *psdoc, int fontid, float size) {
 	PSFont *psfont;
+	int category;
+
 	if(NULL == psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE|PS_SCOPE_PATTERN|PS_SCOPE_TEMPLATE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page', 'pattern', or 'template' scope."), __FUNCTION__);
 		return;
@@ -4383,6 +4848,7 @@ PS_setfont(PSDoc *psdoc, int fontid, float size) {
 	ps_set_word_spacing(psdoc, psdoc->font, 0.0);
 	PS_set_value(psdoc, "leading", size*1.2);
 	if(psfont->metrics) {
+		category = ps_set_stats_category(psdoc, PS_STATS_TEXT);
 #ifdef WIN32
 		if(_stricmp(psfont->metrics->codingscheme, "FontSpecific") == 0) {
 #else
@@ -4393,6 +4859,7 @@ PS_setfont(PSDoc *psdoc, int fontid, float size) {
 			ps_printf(psdoc, "/%s /%s-%s fontenc-%s ReEncode\n", psfont->metrics->fontname, psfont->metrics->fontname, psfont->metrics->codingscheme, psfont->metrics->codingscheme);
 			ps_printf(psdoc, "/%s-%s findfont %f scalefont setfont\n", psfont->metrics->fontname, psfont->metrics->codingscheme, size);
 		}
+		ps_set_stats_category(psdoc, category);
 	}
 }
 /* }}} */
@@ -4411,14 +4878,155 @@ PS_getfont(PSDoc *psdoc) {
 }
 /* }}} */
 
-/* PS_open_image() {{{
+/* _ps_image_colors() {{{
+ * Returns the number of color components written into the document.
+ * The alpha channel of rgb images is left out.
+ */
+static int
+_ps_image_colors(PSImage *image) {
+	if(image->components == 4 && image->colorspace == PS_COLORSPACE_RGB)
+		return(3);
+	return(image->components);
+}
+/* }}} */
+
+/* _ps_write_image_header() {{{
+ * Outputs the code reading image data which is written in parts. The
+ * data of a reusable image is defined under its name, otherwise it is
+ * the data source of the image dictionary started by PS_place_image().
+ */
+static void
+_ps_write_image_header(PSDoc *psdoc, PSImage *image, PSImageFilter *filter) {
+	if(image->isreusable) {
+		ps_printf(psdoc, "/%s\n", image->name);
+		ps_printf(psdoc, "currentfile\n");
+		ps_puts(psdoc, "<< ");
+		ps_write_image_filter(psdoc, filter);
+		ps_puts(psdoc, " >>\n");
+		ps_begin_image_data(psdoc, filter, "/ReusableStreamDecode filter\n");
+	} else {
+		ps_puts(psdoc, "  /DataSource ");
+		ps_write_image_datasource(psdoc, filter);
+		ps_putc(psdoc, '\n');
+		ps_begin_image_data(psdoc, filter, ">> image\n");
+	}
+}
+/* }}} */
+
+/* _ps_write_image_trailer() {{{
+ * Ends image data started with _ps_write_image_header()
+ */
+static void
+_ps_write_image_trailer(PSDoc *psdoc, PSImage *image, PSImageFilter *filter) {
+	ps_end_image_data(psdoc, filter);
+	if(image->isreusable)
+		ps_printf(psdoc, "\ndef\n");
+}
+/* }}} */
+
+/* _ps_digest_string() {{{
+ * Adds a string including its terminating NUL to a digest. NULL is
+ * taken as an empty string.
+ */
+static void
+_ps_digest_string(PSDIGEST *d, const char *str) {
+	if(str)
+		ps_digest_update(d, str, strlen(str));
+	ps_digest_update(d, "", 1);
+}
+/* }}} */
+
+/* _ps_image_digest_new() {{{
+ * Starts the digest identifying an image in the image cache. Besides
+ * the source of the image, which is added by the caller, it covers the
+ * arguments of the open call and all parameters changing the output of
+ * the image. Returns NULL if the parameter 'imagecache' is not set.
+ */
+static PSDIGEST *
+_ps_image_digest_new(PSDoc *psdoc, const char *type, const char *stringparam, int intparam) {
+	static const char *parameters[] = {"imagereuse", "imageencoding", "imagepredictor", "imagepassthrough", "binarydata", NULL};
+	const char *imgcache;
+	char buffer[50];
+	PSDIGEST *d;
+	int i;
+
+	imgcache = PS_get_parameter(psdoc, "imagecache", 0.0);
+	if(!imgcache || strcmp(imgcache, "true") != 0)
+		return NULL;
+	if(NULL == (d = ps_digest_new(psdoc, PS_DIGEST_SHA256)))
+		return NULL;
+	_ps_digest_string(d, type);
+	_ps_digest_string(d, stringparam);
+	for(i=0; parameters[i]; i++)
+		_ps_digest_string(d, PS_get_parameter(psdoc, parameters[i], 0.0));
+	sprintf(buffer, "%d %d %d", intparam, psdoc->imagecompressionlevel, psdoc->languagelevel);
+	_ps_digest_string(d, buffer);
+	return(d);
+}
+/* }}} */
+
+/* _ps_image_cache_get() {{{
+ * Finishes the digest of an image and looks up the image in the image
+ * cache. Reusable data defined on a page is gone at the end of the
+ * page, such an image is only found on the same page. Returns the id of
+ * the image or 0 if there is none.
+ */
+static int
+_ps_image_cache_get(PSDoc *psdoc, PSDIGEST *d, unsigned char *digest) {
+	PSImage *image;
+	int imageid;
+
+	ps_digest_final(d, digest);
+	ps_digest_delete(psdoc, d);
+	if(NULL == psdoc->imagecache)
+		return(0);
+	if(NULL == (image = ght_get(psdoc->imagecache, PS_DIGEST_MAXSIZE, digest)))
+		return(0);
+	if(image->page != 0 && (image->page != psdoc->page || !ps_check_scope(psdoc, PS_SCOPE_PAGE)))
+		return(0);
+	if(0 == (imageid = _ps_find_image(psdoc, image)))
+		return(0);
+	image->refcount++;
+	return(imageid);
+}
+/* }}} */
+
+/* _ps_image_cache_put() {{{
+ * Adds an image to the image cache. An image with the same digest,
+ * whose data is no longer available, is replaced.
+ */
+static void
+_ps_image_cache_put(PSDoc *psdoc, PSImage *image, const unsigned char *digest) {
+	PSImage *old;
+
+	if(NULL == psdoc->imagecache) {
+		if(NULL == (psdoc->imagecache = ght_create(64)))
+			return;
+		ght_set_alloc(psdoc->imagecache, ps_ght_malloc, ps_ght_free, psdoc);
+	}
+	memcpy(image->digest, digest, PS_DIGEST_MAXSIZE);
+	if(image->isreusable && ps_check_scope(psdoc, PS_SCOPE_PAGE))
+		image->page = psdoc->page;
+	if(NULL != (old = ght_get(psdoc->imagecache, PS_DIGEST_MAXSIZE, image->digest))) {
+		old->cached = ps_false;
+		ght_replace(psdoc->imagecache, image, PS_DIGEST_MAXSIZE, image->digest);
+	} else if(0 != ght_insert(psdoc->imagecache, image, PS_DIGEST_MAXSIZE, image->digest))
+		return;
+	image->cached = ps_true;
+}
+/* }}} */
+
+/* _ps_open_image() {{{
  * Opens an image which is already in memory
  */
-PSLIB_API int PSLIB_CALL
-PS_open_image(PSDoc *psdoc, const char *type, const char *source, const char *data, long length, int width, int height, int components, int bpc, const char *params) {
+static int
+_ps_open_image(PSDoc *psdoc, const char *type, const char *source, const char *data, long length, int width, int height, int components, int bpc, const char *params) {
 	PSImage *psimage;
 	int imageid;
 	const char *imgreuse;
+	PSDIGEST *imgdigest;
+	unsigned char digest[PS_DIGEST_MAXSIZE];
+	int cacheable = 0;
 	
 	if(NULL == psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
@@ -4436,20 +5044,31 @@ PS_open_image(PSDoc *psdoc, const char *type, const char *source, const char *da
 		}
 
 		if(ps_check_scope(psdoc, PS_SCOPE_DOCUMENT|PS_SCOPE_PAGE)) {
-			ps_error(psdoc, PS_Warning, _("Calling %s between pages or on pages for reusable images may cause problems when viewing the document. Call it before the first page."), __FUNCTION__);
+			ps_error(psdoc, PS_Warning, _("Calling %s between pages or on pages for reusable images may cause problems when viewing the document. Call it before the first page."), "PS_open_image");
 		}
 
 		if(!ps_check_scope(psdoc, PS_SCOPE_DOCUMENT|PS_SCOPE_PAGE|PS_SCOPE_PROLOG)) {
-			ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'document' or 'page' scope."), __FUNCTION__);
+			ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'document' or 'page' scope."), "PS_open_image");
 			return 0;
 		}
 	} else {
 		if(!ps_check_scope(psdoc, PS_SCOPE_DOCUMENT|PS_SCOPE_PAGE)) {
-			ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'document' or 'page' scope."), __FUNCTION__);
+			ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'document' or 'page' scope."), "PS_open_image");
 			return 0;
 		}
 	}
 
+	/* The same image may have been opened before */
+	if(NULL != (imgdigest = _ps_image_digest_new(psdoc, type, params, 0))) {
+		char buffer[100];
+		sprintf(buffer, "%ld %d %d %d %d", length, width, height, components, bpc);
+		_ps_digest_string(imgdigest, buffer);
+		ps_digest_update(imgdigest, data, length);
+		if(0 != (imageid = _ps_image_cache_get(psdoc, imgdigest, digest)))
+			return(imageid);
+		cacheable = 1;
+	}
+
 	if(NULL == (psimage = (PSImage *) psdoc->malloc(psdoc, sizeof(PSImage), _("Allocate memory for image.")))) {
 		ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for image."));
 		return(0);
@@ -4503,7 +5122,7 @@ PS_open_image(PSDoc *psdoc, const char *type, const char *source, const char *da
 	if(!imgreuse || strcmp(imgreuse, "true") == 0) {
 		char buffer[25];
 		psimage->isreusable = 1;
-		sprintf(buffer, "Imagedata%d", rand());
+		sprintf(buffer, "Imagedata%d", ++psdoc->imagedatacnt);
 		psimage->name = ps_strdup(psdoc, buffer);
 	}
 
@@ -4526,108 +5145,345 @@ PS_open_image(PSDoc *psdoc, const char *type, const char *source, const char *da
 			ps_printf(psdoc, "*EOD*\n");
 			ps_printf(psdoc, "def\n");
 		} else {
-			char *tmpdata;
-			const char *imgenc;
-			int reallength, j;
+			PSImageFilter filter;
 
-			imgenc = PS_get_parameter(psdoc, "imageencoding", 0.0);
+			ps_init_image_filter(psdoc, &filter, _ps_image_colors(psimage), psimage->components, psimage->bpc, psimage->width, psimage->compression, psimage->data, psimage->length);
 			ps_printf(psdoc, "/%s\n", psimage->name);
 			ps_printf(psdoc, "currentfile\n");
-			ps_printf(psdoc, "<< /Filter /ASCII%sDecode >>\n", (imgenc == NULL || strcmp(imgenc, "hex") != 0) ? "85" : "Hex");
-			ps_printf(psdoc, "/ReusableStreamDecode filter\n");
-
-			if(psimage->components == 4 && psimage->colorspace == PS_COLORSPACE_RGB) {
-				char *dataptr, *tmpdataptr;
-				int j;
-				dataptr = psimage->data;
-				reallength = psimage->height*psimage->width*3;
-				tmpdata = tmpdataptr = psdoc->malloc(psdoc, psimage->height*psimage->width*3, _("Allocate memory for temporary image data."));
-				for(j=0; j<psimage->length; j++) {
-					*tmpdataptr++ = *dataptr++;
-					*tmpdataptr++ = *dataptr++;
-					*tmpdataptr++ = *dataptr++;
-					dataptr++;
-				}
-			} else {
-				tmpdata = psimage->data;
-				reallength = psimage->length;
-			}
-			if(imgenc == NULL || strcmp(imgenc, "hex") != 0)
-				ps_ascii85_encode(psdoc, tmpdata, reallength);
-			else
-				ps_asciihex_encode(psdoc, tmpdata, reallength);
-			if(psimage->components == 4 && psimage->colorspace == PS_COLORSPACE_RGB)
-				psdoc->free(psdoc, tmpdata);
+			ps_puts(psdoc, "<< ");
+			ps_write_image_filter(psdoc, &filter);
+			ps_puts(psdoc, " >>\n");
+			ps_write_image_data(psdoc, &filter, "/ReusableStreamDecode filter\n");
 
 			ps_printf(psdoc, "\ndef\n");
 		}
 	}
 
+	psimage->refcount = 1;
+	if(cacheable)
+		_ps_image_cache_put(psdoc, psimage, digest);
 	return(imageid);
 }
 /* }}} */
 
-/* PS_open_image_file() {{{
- * Opens an image from a file
+/* PS_open_image() {{{
+ * Calls _ps_open_image() and measures the time spent in it
  */
 PSLIB_API int PSLIB_CALL
-PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const char *stringparam, int intparam) {
-	PSImage *psimage;
-	int imageid;
-	const char *imgreuse;
+PS_open_image(PSDoc *psdoc, const char *type, const char *source, const char *data, long length, int width, int height, int components, int bpc, const char *params) {
+	int imageid, category;
+
+	ps_stats_start_timer(psdoc, PS_STATS_TIME_IMAGE);
+	category = ps_set_stats_category(psdoc, PS_STATS_IMAGE);
+	imageid = _ps_open_image(psdoc, type, source, data, length, width, height, components, bpc, params);
+	ps_set_stats_category(psdoc, category);
+	ps_stats_stop_timer(psdoc, PS_STATS_TIME_IMAGE);
+	return(imageid);
+}
+/* }}} */
+
+/* ps_read_eps_boundingbox() {{{
+ * Searches the eps file for the first '%%BoundingBox:' comment in front
+ * of any NUL byte and reads the four values following it. The file is
+ * read in small pieces. Returns 0 if the comment was found, otherwise -1.
+ */
+static int ps_read_eps_boundingbox(FILE *fp, float *x, float *y, float *width, float *height) {
+	char buffer[4096];
+	char *bb;
+	size_t len = 0, n;
+	int atend = 0;
+
+	*x = *y = *width = *height = 0.0;
+	while(!atend) {
+		n = fread(&buffer[len], 1, sizeof(buffer)-1-len, fp);
+		if(n == 0)
+			atend = 1;
+		len += n;
+		buffer[len] = '\0';
+		if(strlen(buffer) < len) {
+			len = strlen(buffer);
+			atend = 1;
+		}
+		if(NULL != (bb = strstr(buffer, "%%BoundingBox:"))) {
+			/* Make sure the values are in the buffer as well */
+			if(!atend && len - (bb - buffer) < 256) {
+				len -= bb - buffer;
+				memmove(buffer, bb, len);
+				n = fread(&buffer[len], 1, sizeof(buffer)-1-len, fp);
+				len += n;
+				buffer[len] = '\0';
+				bb = buffer;
+			}
+			if(strlen(bb) > 15)
+				sscanf(bb+15, "%f %f %f %f", x, y, width, height);
+			return(0);
+		}
+		/* Keep the end of the buffer, it could be the start of the comment */
+		if(len > 13) {
+			memmove(buffer, &buffer[len-13], 13);
+			len = 13;
+		}
+	}
+	return(-1);
+}
+/* }}} */
+
+/* ps_write_eps_file() {{{
+ * Outputs the content of the eps file of an image
+ */
+static int ps_write_eps_file(PSDoc *psdoc, PSImage *psimage) {
 	FILE *fp;
 
-	if(NULL == psdoc) {
-		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
-		return 0;
+	if(NULL == (fp = fopen(psimage->filename, "rb"))) {
+		ps_error(psdoc, PS_IOError, _("Could not open eps file '%s'."), psimage->filename);
+		return(-1);
+	}
+	if(ps_write_file(psdoc, fp, psimage->length) < psimage->length) {
+		ps_error(psdoc, PS_IOError, _("Could not read eps file '%s' completely."), psimage->filename);
+		fclose(fp);
+		return(-1);
 	}
+	fclose(fp);
+	return(0);
+}
+/* }}} */
 
-	imgreuse = PS_get_parameter(psdoc, "imagereuse", 0.0);
-	if(!imgreuse || strcmp(imgreuse, "true") == 0) {
-		/* If the header is not written, because we are before
-		 * the first page, then output the header first.
-		 */
-		if(psdoc->beginprologwritten == ps_false) {
-			ps_write_ps_comments(psdoc);
-			ps_write_ps_beginprolog(psdoc);
-		}
+/* _ps_image_passthrough() {{{
+ * Checks if the compressed data of a jpeg file can be embedded as it is.
+ * This requires the parameter 'imagepassthrough' to be set and an image
+ * which can be decoded by the DCTDecode filter.
+ */
+static int
+_ps_image_passthrough(PSDoc *psdoc, FILE *fp) {
+	const char *passthrough;
+	PSImage image;
 
-		if(ps_check_scope(psdoc, PS_SCOPE_DOCUMENT|PS_SCOPE_PAGE)) {
-			ps_error(psdoc, PS_Warning, _("Calling %s between pages or on pages for reusable images may cause problems when viewing the document. Call it before the first page."), __FUNCTION__);
-		}
+	passthrough = PS_get_parameter(psdoc, "imagepassthrough", 0.0);
+	if(!passthrough || strcmp(passthrough, "true") != 0)
+		return(0);
+	memset(&image, 0, sizeof(PSImage));
+	if(0 != ps_read_jpeg_header(psdoc, fp, &image)) {
+		ps_error(psdoc, PS_Warning, _("Data of jpeg image cannot be embedded as it is. Decoding image."));
+		return(0);
+	}
+	return(1);
+}
+/* }}} */
 
-		if(!ps_check_scope(psdoc, PS_SCOPE_DOCUMENT|PS_SCOPE_PAGE|PS_SCOPE_PROLOG)) {
-			ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'document' or 'page' scope."), __FUNCTION__);
-			return 0;
-		}
-	} else {
-		if(!ps_check_scope(psdoc, PS_SCOPE_DOCUMENT|PS_SCOPE_PAGE)) {
-			ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'document' or 'page' scope."), __FUNCTION__);
-			return 0;
-		}
+/* _ps_image_decoding() {{{
+ * Returns when image files are decoded as set by the parameter
+ * 'imagedecoding'
+ */
+static int
+_ps_image_decoding(PSDoc *psdoc) {
+	const char *decoding;
+
+	decoding = PS_get_parameter(psdoc, "imagedecoding", 0.0);
+	if(decoding == NULL)
+		return(PS_DECODE_OPEN);
+	if(0 == strcmp(decoding, "lazy"))
+		return(PS_DECODE_LAZY);
+	if(0 == strcmp(decoding, "transient"))
+		return(PS_DECODE_TRANSIENT);
+	return(PS_DECODE_OPEN);
+}
+/* }}} */
+
+#ifdef HAVE_LIBPNG
+/* _ps_png_set_transforms() {{{
+ * Sets up libpng for returning rows without an alpha channel and with
+ * at most 8 bits per component. Grayscale images get 8 bits per pixel.
+ */
+static void
+_ps_png_set_transforms(png_structp png_ptr, png_infop info_ptr) {
+	int color_type, bit_depth;
+
+	color_type = png_get_color_type(png_ptr, info_ptr);
+	bit_depth = png_get_bit_depth(png_ptr, info_ptr);
+	if (bit_depth == 16) {
+		png_set_strip_16(png_ptr);
 	}
 
-	if(NULL == filename) {
-		ps_error(psdoc, PS_RuntimeError, _("Filename of images is NULL."));
-		return 0;
+	/* FIXME: Quick fix to circumvent a segm fault in ps_place_image()
+	 * when rgb images with alpha channel are loaded.
+	 */
+	if (color_type & PNG_COLOR_MASK_ALPHA)
+		png_set_strip_alpha(png_ptr);
+
+	/* Expand grayscale images to the full 8 bits from 1, 2, or 4 bits/pixel */
+	if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
+#if defined(PNG_1_0_X) || defined (PNG_1_2_X)
+		png_set_gray_1_2_4_to_8(png_ptr);
+#else
+		png_set_expand_gray_1_2_4_to_8(png_ptr);
+#endif
+
+	png_read_update_info(png_ptr, info_ptr);
+}
+/* }}} */
+
+/* _ps_png_passthrough() {{{
+ * Checks if the compressed data of a png file can be embedded as it is.
+ * This requires the parameter 'imagepassthrough' to be set, the
+ * /FlateDecode filter of language level 3 and samples which PostScript
+ * can take as they are: no alpha channel, no interlacing and at most 8
+ * bits per component.
+ */
+static int
+_ps_png_passthrough(PSDoc *psdoc, png_structp png_ptr, png_infop info_ptr) {
+	const char *passthrough;
+	int color_type;
+
+	passthrough = PS_get_parameter(psdoc, "imagepassthrough", 0.0);
+	if(!passthrough || strcmp(passthrough, "true") != 0)
+		return(0);
+	color_type = png_get_color_type(png_ptr, info_ptr);
+	if(psdoc->languagelevel == 2 ||
+	   png_get_interlace_type(png_ptr, info_ptr) != PNG_INTERLACE_NONE ||
+	   png_get_bit_depth(png_ptr, info_ptr) > 8 ||
+	   (color_type != PNG_COLOR_TYPE_GRAY && color_type != PNG_COLOR_TYPE_RGB && color_type != PNG_COLOR_TYPE_PALETTE)) {
+		ps_error(psdoc, PS_Warning, _("Data of png image cannot be embedded as it is. Decoding image."));
+		return(0);
 	}
+	return(1);
+}
+/* }}} */
 
-	if ((fp = fopen(filename, "rb")) == NULL) {
-		ps_error(psdoc, PS_RuntimeError, _("Could not open image file %s."), filename);
-		return 0;
+/* _ps_png_write_rows() {{{
+ * Decodes the rows of a png file and writes them into the image data
+ * set up in filter, bandrows rows at a time. The code reading the data
+ * is output with the first band. The number of rows written is kept in
+ * rows, which is less than the height of the image if the file could
+ * not be read.
+ */
+static void
+_ps_png_write_rows(PSDoc *psdoc, FILE *fp, PSImage *image, PSImageFilter *filter, char *band, size_t rowbytes, size_t bandrows, size_t *rows) {
+	png_structp png_ptr;
+	png_infop info_ptr;
+	size_t i, n;
+
+	if(NULL == (png_ptr = png_create_read_struct(PNG_LIBPNG_VER_STRING, NULL, NULL, NULL)))
+		return;
+	if(NULL == (info_ptr = png_create_info_struct(png_ptr))) {
+		png_destroy_read_struct(&png_ptr, (png_infopp)NULL, (png_infopp)NULL);
+		return;
+	}
+	/* Only data behind the pointers passed in is changed after this
+	 * point, so it is still valid after an error */
+	if (setjmp(png_jmpbuf(png_ptr))) {
+		png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+		return;
 	}
+	png_init_io(png_ptr, fp);
+	png_read_info(png_ptr, info_ptr);
+	/* Data which would be passed through is used without any changes */
+	if(image->compression == PS_IMAGECOMP_FLATE)
+		png_read_update_info(png_ptr, info_ptr);
+	else
+		_ps_png_set_transforms(png_ptr, info_ptr);
+	if(png_get_rowbytes(png_ptr, info_ptr) == rowbytes && png_get_image_height(png_ptr, info_ptr) == (png_uint_32) image->height) {
+		while(*rows < (size_t) image->height) {
+			n = image->height - *rows;
+			if(n > bandrows)
+				n = bandrows;
+			for(i=0; i<n; i++)
+				png_read_row(png_ptr, (png_bytep) band + i*rowbytes, NULL);
+			if(*rows == 0) {
+				ps_init_image_stream(psdoc, filter, image->components, image->bpc, image->width, PS_IMAGECOMP_NONE, band, n*rowbytes, rowbytes*image->height);
+				_ps_write_image_header(psdoc, image, filter);
+			}
+			ps_write_image_stream(psdoc, filter, band, n*rowbytes);
+			*rows += n;
+		}
+	}
+	png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
+}
+/* }}} */
 
-	if(NULL == type) {
-		ps_error(psdoc, PS_RuntimeError, _("Type of image is NULL."));
-		return 0;
+/* _ps_write_png_file() {{{
+ * Reads the png file of an image again and writes its data, either as
+ * the definition of a reusable image or as the data source of an image
+ * placed on the page. Only a band of rows is held in memory. The IDAT
+ * chunks are copied instead, if the image was opened for passing its
+ * data through. If the file cannot be read, the missing rows are filled
+ * with zeros and -1 is returned.
+ */
+static int
+_ps_write_png_file(PSDoc *psdoc, PSImage *image) {
+	PSImageFilter filter;
+	FILE *fp;
+	char *band;
+	size_t rowbytes, bandrows, len, rows = 0;
+	int ret = 0;
+
+	fp = fopen(image->filename, "rb");
+	if(NULL != fp && image->compression == PS_IMAGECOMP_FLATE && 0 < (len = ps_png_idat_length(fp, image->width, image->height, image->bpc, image->components))) {
+		ps_init_image_stream(psdoc, &filter, image->components, image->bpc, image->width, PS_IMAGECOMP_FLATE, NULL, 0, len);
+		_ps_write_image_header(psdoc, image, &filter);
+		if(0 != ps_write_png_idat(psdoc, fp, &filter)) {
+			ps_error(psdoc, PS_RuntimeError, _("Could not read image file %s."), image->filename);
+			ret = -1;
+		}
+		_ps_write_image_trailer(psdoc, image, &filter);
+		fclose(fp);
+		return(ret);
+	}
+
+	rowbytes = ((size_t) image->width * image->components * image->bpc + 7) / 8;
+	bandrows = PS_IMAGE_BANDSIZE / rowbytes;
+	if(bandrows == 0)
+		bandrows = 1;
+	if(bandrows > (size_t) image->height)
+		bandrows = image->height;
+	if(NULL == (band = psdoc->malloc(psdoc, bandrows*rowbytes, _("Allocate memory for rows of png image.")))) {
+		ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for rows of png image."));
+		if(fp)
+			fclose(fp);
+		return(-1);
 	}
+	/* libpng keeps the unused bits at the end of a row as they are in
+	 * the buffer */
+	memset(band, 0, bandrows*rowbytes);
+	if(fp) {
+		_ps_png_write_rows(psdoc, fp, image, &filter, band, rowbytes, bandrows, &rows);
+		fclose(fp);
+	}
+	if(rows < (size_t) image->height) {
+		ps_error(psdoc, PS_RuntimeError, _("Could not read image file %s."), image->filename);
+		memset(band, 0, bandrows*rowbytes);
+		if(rows == 0) {
+			ps_init_image_stream(psdoc, &filter, image->components, image->bpc, image->width, PS_IMAGECOMP_NONE, band, bandrows*rowbytes, rowbytes*image->height);
+			_ps_write_image_header(psdoc, image, &filter);
+		}
+		for(; rows < (size_t) image->height; rows++)
+			ps_write_image_stream(psdoc, &filter, band, rowbytes);
+		ret = -1;
+	}
+	_ps_write_image_trailer(psdoc, image, &filter);
+	psdoc->free(psdoc, band);
+	return(ret);
+}
+/* }}} */
+#endif /* HAVE_LIBPNG */
+
+/* _ps_read_image_file() {{{
+ * Reads an image of the given type from the file fp opened as filename.
+ * If headeronly is set, only the size and color space of the image are
+ * read from jpeg, gif, tiff, bmp and interlaced png files, but not their
+ * samples. If streamable is set, the samples of other png files are not
+ * read either, but decoded again from the file when they are written.
+ * The file is not closed. Returns NULL in case of an error.
+ */
+static PSImage *
+_ps_read_image_file(PSDoc *psdoc, const char *type, const char *filename, FILE *fp, const char *stringparam, int intparam, int headeronly, int streamable) {
+	PSImage *psimage;
 
 #ifdef HAVE_LIBPNG
 	if(0 == strncmp("png", type, 3)) {
 #define SIG_READ 8
 		char *dataptr, sig[SIG_READ];
 		int i;
-		int color_type, bit_depth;
+		int streamed = 0, passthrough = 0;
 		png_structp png_ptr;
 		png_infop info_ptr;
 		png_uint_32 row_bytes;
@@ -4639,17 +5495,15 @@ PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const c
 
 		if (png_ptr == NULL) {
 			ps_error(psdoc, PS_RuntimeError, _("Could not create png structure."));
-			fclose(fp);
-			return(0);
+			return(NULL);
 		}
 
 		/* Allocate/initialize the memory for image information.  REQUIRED. */
 		info_ptr = png_create_info_struct(png_ptr);
 		if (info_ptr == NULL) {
 			ps_error(psdoc, PS_RuntimeError, _("Could not create png info structure."));
-			fclose(fp);
 			png_destroy_read_struct(&png_ptr, (png_infopp)NULL, (png_infopp)NULL);
-			return(0);
+			return(NULL);
 		}
 
 		/* Set error handling if you are using the setjmp/longjmp method (this is
@@ -4660,15 +5514,13 @@ PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const c
 			/* Free all of the memory associated with the png_ptr and info_ptr */
 			ps_error(psdoc, PS_RuntimeError, _("Could not set error handler for libpng."));
 			png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
-			fclose(fp);
 			/* If we get here, we had a problem reading the file */
-			return (0);
+			return(NULL);
 		}
 
 		if (fread(sig, 1, SIG_READ, fp) == 0 || !png_check_sig(sig, SIG_READ)) {
-			fclose(fp);
 			ps_error(psdoc, PS_RuntimeError, "File '%s' is not a PNG file", filename);
-			return (0);
+			return(NULL);
 		}
 
 		/* Set up the input control if you are using standard C streams */
@@ -4688,27 +5540,19 @@ PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const c
 #define mymemory
 #ifdef mymemory
 		png_read_info(png_ptr, info_ptr);
-		color_type = png_get_color_type(png_ptr, info_ptr);
-		bit_depth = png_get_bit_depth(png_ptr, info_ptr);
-		if (bit_depth == 16) {
-			png_set_strip_16(png_ptr);
-		}
-
-		/* FIXME: Quick fix to circumvent a segm fault in ps_place_image()
-		 * when rgb images with alpha channel are loaded.
-		 */
-		if (color_type & PNG_COLOR_MASK_ALPHA)
-			png_set_strip_alpha(png_ptr);
-
-		/* Expand grayscale images to the full 8 bits from 1, 2, or 4 bits/pixel */
-		if (color_type == PNG_COLOR_TYPE_GRAY && bit_depth < 8)
-#if defined(PNG_1_0_X) || defined (PNG_1_2_X)
-			png_set_gray_1_2_4_to_8(png_ptr);
-#else
-			png_set_expand_gray_1_2_4_to_8(png_ptr);
-#endif
-
-		png_read_update_info(png_ptr, info_ptr);
+		/* The rows of the image are not read now but decoded again from
+		 * the file when the data is written, if the caller allows it and
+		 * the image is not needed as a mask. Interlaced images are read
+		 * completely, because their rows are only complete after the
+		 * last pass. */
+		streamed = streamable && (stringparam == NULL || strcmp(stringparam, "mask") != 0);
+		passthrough = streamed && _ps_png_passthrough(psdoc, png_ptr, info_ptr);
+		if(png_get_interlace_type(png_ptr, info_ptr) != PNG_INTERLACE_NONE)
+			streamed = 0;
+		if(passthrough)
+			png_read_update_info(png_ptr, info_ptr);
+		else
+			_ps_png_set_transforms(png_ptr, info_ptr);
 #else
 		/* Read the entire image */
 		png_read_png(png_ptr, info_ptr, PNG_TRANSFORM_IDENTITY, png_voidp_NULL);
@@ -4716,8 +5560,7 @@ PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const c
 
 		if(NULL == (psimage = (PSImage *) psdoc->malloc(psdoc, sizeof(PSImage), _("Allocate memory for image.")))) {
 			ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for image."));
-			fclose(fp);
-			return(0);
+			return(NULL);
 		}
 		memset(psimage, 0, sizeof(PSImage));
 
@@ -4731,7 +5574,7 @@ PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const c
 				ps_error(psdoc, PS_RuntimeError, _("Could not find image mask."));
 				psdoc->free(psdoc, psimage);
 				
-				return(0);
+				return(NULL);
 			}
 			psimage->imagemask = psmaskimage;
 		}
@@ -4761,8 +5604,7 @@ PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const c
 			if(NULL == (psimage->palette = psdoc->malloc(psdoc, sizeof(PSColor) * num_palette, _("Allocate memory for color palette.")))) {
 				ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for color palette."));
 				psdoc->free(psdoc, psimage);
-				fclose(fp);
-				return(0);
+				return(NULL);
 			}
 			for(i=0; i<num_palette; i++) {
 				psimage->palette[i].colorspace = PS_COLORSPACE_RGB;
@@ -4783,51 +5625,97 @@ PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const c
 		fprintf(stderr, "%d bytes per row\n", row_bytes);
 */
 
-		if(NULL == (psimage->data = psdoc->malloc(psdoc, psimage->height*row_bytes, _("Allocate memory for image data.")))) {
-			ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for image data."));
-			psdoc->free(psdoc, psimage);
-			fclose(fp);
-			return(0);
-		}
+		if(streamed) {
+			/* The file is read again when the image data is written */
+			psimage->filename = ps_strdup(psdoc, filename);
+			if(passthrough)
+				psimage->compression = PS_IMAGECOMP_FLATE;
+		} else if(!headeronly) {
+			if(NULL == (psimage->data = psdoc->malloc(psdoc, psimage->height*row_bytes, _("Allocate memory for image data.")))) {
+				ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for image data."));
+				psdoc->free(psdoc, psimage);
+				return(NULL);
+			}
 
 #ifdef mymemory
-		if(NULL == (row_pointers = psdoc->malloc(psdoc, psimage->height*sizeof(png_bytep), _("Allocate memory for row pointers of png image.")))) {
-			ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for row pointer of png image."));
-			psdoc->free(psdoc, psimage->data);
-			psdoc->free(psdoc, psimage);
-			fclose(fp);
-			return(0);
-		}
+			if(NULL == (row_pointers = psdoc->malloc(psdoc, psimage->height*sizeof(png_bytep), _("Allocate memory for row pointers of png image.")))) {
+				ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for row pointer of png image."));
+				psdoc->free(psdoc, psimage->data);
+				psdoc->free(psdoc, psimage);
+				return(NULL);
+			}
 
-		dataptr = psimage->data;
-		for(i=0; i<psimage->height; i++) {
-			row_pointers[i] = dataptr;
+			dataptr = psimage->data;
+			for(i=0; i<psimage->height; i++) {
+				row_pointers[i] = dataptr;
 //			fprintf(stderr, "Reading row %d\n", i);
 //			png_read_row(png_ptr, dataptr, NULL);
-			dataptr += row_bytes;
-		}
-		png_read_image(png_ptr, row_pointers);
-		png_read_end(png_ptr, NULL);
-		psdoc->free(psdoc, row_pointers);
+				dataptr += row_bytes;
+			}
+			png_read_image(png_ptr, row_pointers);
+			png_read_end(png_ptr, NULL);
+			psdoc->free(psdoc, row_pointers);
 #else
-		row_pointers = png_get_rows(png_ptr, info_ptr);
-		if(row_pointers == NULL) {
-			ps_error(psdoc, PS_MemoryError, _("Could get array of image rows."));
-			psdoc->free(psdoc, psimage->data);
-			return(0);
-		}
-		dataptr = psimage->data;
-		for(i=0; i<psimage->height; i++) {
-			fprintf(stderr, "Copying %d row 0x%X -> 0x%X\n", i, row_pointers[i], dataptr);
-			memcpy(dataptr, row_pointers[i], row_bytes);
-			dataptr += row_bytes;
-		}
+			row_pointers = png_get_rows(png_ptr, info_ptr);
+			if(row_pointers == NULL) {
+				ps_error(psdoc, PS_MemoryError, _("Could get array of image rows."));
+				psdoc->free(psdoc, psimage->data);
+				return(NULL);
+			}
+			dataptr = psimage->data;
+			for(i=0; i<psimage->height; i++) {
+				fprintf(stderr, "Copying %d row 0x%X -> 0x%X\n", i, row_pointers[i], dataptr);
+				memcpy(dataptr, row_pointers[i], row_bytes);
+				dataptr += row_bytes;
+			}
 #endif
+		}
 		/* clean up after the read, and free any memory allocated - REQUIRED */
 		png_destroy_read_struct(&png_ptr, &info_ptr, (png_infopp)NULL);
 
 	} else
 #endif /* HAVE_LIBPNG */
+	if(0 == strncmp("jpeg", type, 4) && _ps_image_passthrough(psdoc, fp)) {
+		long filesize;
+
+		/* The compressed data is embedded as it is and decoded by
+		 * the DCTDecode filter */
+		if(NULL == (psimage = (PSImage *) psdoc->malloc(psdoc, sizeof(PSImage), _("Allocate memory for image.")))) {
+			ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for image."));
+			return(NULL);
+		}
+		memset(psimage, 0, sizeof(PSImage));
+		ps_read_jpeg_header(psdoc, fp, psimage);
+
+		psimage->psdoc = psdoc;
+		psimage->type = ps_strdup(psdoc, type);
+		psimage->compression = PS_IMAGECOMP_DCT;
+		if(!headeronly) {
+			fseek(fp, 0, SEEK_END);
+			filesize = ftell(fp);
+			rewind(fp);
+			if(filesize <= 0) {
+				ps_error(psdoc, PS_RuntimeError, _("Image file %s is empty or cannot be read."), filename);
+				psdoc->free(psdoc, psimage->type);
+				psdoc->free(psdoc, psimage);
+				return(NULL);
+			}
+			if(NULL == (psimage->data = psdoc->malloc(psdoc, filesize, _("Allocate memory for image data.")))) {
+				ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for image data."));
+				psdoc->free(psdoc, psimage->type);
+				psdoc->free(psdoc, psimage);
+				return(NULL);
+			}
+			psimage->length = fread(psimage->data, 1, filesize, fp);
+			if(psimage->length != filesize) {
+				ps_error(psdoc, PS_RuntimeError, _("Image file %s is empty or cannot be read."), filename);
+				psdoc->free(psdoc, psimage->data);
+				psdoc->free(psdoc, psimage->type);
+				psdoc->free(psdoc, psimage);
+				return(NULL);
+			}
+		}
+	} else
 #ifdef HAVE_LIBJPEG
 	if(0 == strncmp("jpeg", type, 4)) {
 		char *dataptr;
@@ -4840,13 +5728,17 @@ PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const c
 		jpeg_create_decompress(&cinfo);
 		jpeg_stdio_src(&cinfo, fp);
 		jpeg_read_header(&cinfo, TRUE);
-		jpeg_start_decompress(&cinfo);
+		/* Starting decompression would already decode progressive
+		 * jpeg files */
+		if(headeronly)
+			jpeg_calc_output_dimensions(&cinfo);
+		else
+			jpeg_start_decompress(&cinfo);
 		row_stride = cinfo.output_width * cinfo.output_components;
 
 		if(NULL == (psimage = (PSImage *) psdoc->malloc(psdoc, sizeof(PSImage), _("Allocate memory for image.")))) {
 			ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for image."));
-			fclose(fp);
-			return(0);
+			return(NULL);
 		}
 		memset(psimage, 0, sizeof(PSImage));
 
@@ -4873,10 +5765,13 @@ PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const c
 //		else
 //			psimage->colorspace = PS_COLORSPACE_RGB;
 		psimage->length = psimage->width * psimage->height * psimage->components;
+		if(headeronly) {
+			jpeg_destroy_decompress(&cinfo);
+			return(psimage);
+		}
 		if(NULL == (psimage->data = psdoc->malloc(psdoc, psimage->length, _("Allocate memory for image data.")))) {
 			ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for image data."));
-			fclose(fp);
-			return(0);
+			return(NULL);
 		}
 
 		buffer = (*cinfo.mem->alloc_sarray)
@@ -4909,25 +5804,14 @@ PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const c
 
 		if(NULL == (psimage = (PSImage *) psdoc->malloc(psdoc, sizeof(PSImage), _("Allocate memory for image.")))) {
 			ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for image."));
-			fclose(fp);
-			return(0);
+			return(NULL);
 		}
 		memset(psimage, 0, sizeof(PSImage));
 
 		if ((gft = GIF_OPEN_FILENAME(filename)) == NULL) {
 			ps_error(psdoc, PS_RuntimeError, _("%s is not a gif file!"), filename);
-			fclose(fp);
-			return(0);
+			return(NULL);
 		}
-		if (DGifSlurp(gft) != GIF_OK) {
-#if GIFLIB_MAJOR > 5 || GIFLIB_MAJOR == 5 && GIFLIB_MINOR >= 1
-			ps_error(psdoc, PS_RuntimeError, _("Error %d while reading gif file!"), error);
-#else
-			ps_error(psdoc, PS_RuntimeError, _("Error %d while reading gif file!"), GifLastError());
-#endif
-			fclose(fp);
-			return(0);
-    }
 
 		psimage->psdoc = psdoc;
 		psimage->type = ps_strdup(psdoc, type);
@@ -4937,6 +5821,21 @@ PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const c
 		psimage->bpc = 8;
 		psimage->colorspace = PS_COLORSPACE_INDEXED;
 
+		/* The size of the image is known after reading the screen
+		 * descriptor, its palette only after reading the image */
+		if(headeronly) {
+			GIF_CLOSE_FILE(gft);
+			return(psimage);
+		}
+		if (DGifSlurp(gft) != GIF_OK) {
+#if GIFLIB_MAJOR > 5 || GIFLIB_MAJOR == 5 && GIFLIB_MINOR >= 1
+			ps_error(psdoc, PS_RuntimeError, _("Error %d while reading gif file!"), error);
+#else
+			ps_error(psdoc, PS_RuntimeError, _("Error %d while reading gif file!"), GifLastError());
+#endif
+			return(NULL);
+    }
+
 		// look for the transparent color extension
 		for (i = 0; i < gft->SavedImages[0].ExtensionBlockCount; ++i) {
 			ExtensionBlock* eb = gft->SavedImages[0].ExtensionBlocks + i;
@@ -4953,8 +5852,7 @@ PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const c
 			ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for color palette."));
 			GIF_CLOSE_FILE(gft);
 			psdoc->free(psdoc, psimage);
-			fclose(fp);
-			return(0);
+			return(NULL);
 		}
 
 		for (i=0; i<numcolors; i++) {
@@ -4979,8 +5877,7 @@ PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const c
 			GIF_CLOSE_FILE(gft);
 			psdoc->free(psdoc, psimage->palette);
 			psdoc->free(psdoc, psimage);
-			fclose(fp);
-			return(0);
+			return(NULL);
 		}
 
 		if(gft->Image.Interlace) {
@@ -5021,8 +5918,7 @@ PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const c
 
 		if(NULL == (psimage = (PSImage *) psdoc->malloc(psdoc, sizeof(PSImage), _("Allocate memory for image.")))) {
 			ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for image."));
-			fclose(fp);
-			return(0);
+			return(NULL);
 		}
 		memset(psimage, 0, sizeof(PSImage));
 
@@ -5034,13 +5930,16 @@ PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const c
 
 		if(NULL == (tif = TIFFOpen(filename, "r"))) {
 			psdoc->free(psdoc, psimage);
-			fclose(fp);
-			return(0);
+			return(NULL);
 		}
 
 		TIFFGetField(tif, TIFFTAG_IMAGEWIDTH, &(psimage->width));
 		TIFFGetField(tif, TIFFTAG_IMAGELENGTH, &(psimage->height));
 		psimage->length = psimage->width * psimage->height * 3;
+		if(headeronly) {
+			TIFFClose(tif);
+			return(psimage);
+		}
 
 		raster = (uint32*) _TIFFmalloc(psimage->width * psimage->height * sizeof (uint32));
 		if (raster != NULL) {
@@ -5053,8 +5952,7 @@ PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const c
 					psdoc->free(psdoc, psimage);
 					_TIFFfree(raster);
 					TIFFClose(tif);
-					fclose(fp);
-					return(0);
+					return(NULL);
 				}
 
 				dst = psimage->data;
@@ -5083,20 +5981,32 @@ PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const c
 
 		if(NULL == (psimage = (PSImage *) psdoc->malloc(psdoc, sizeof(PSImage), _("Allocate memory for image.")))) {
 			ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for image."));
-			fclose(fp);
-			return(0);
+			return(NULL);
 		}
 		memset(psimage, 0, sizeof(PSImage));
 
 		psimage->psdoc = psdoc;
 		psimage->type = ps_strdup(psdoc, type);
 
+		if(headeronly) {
+			if(0 != read_bmp_header(psdoc, filename, &w, &h, &bps, &spp)) {
+				psdoc->free(psdoc, psimage->type);
+				psdoc->free(psdoc, psimage);
+				return(NULL);
+			}
+			psimage->width = w;
+			psimage->height = h;
+			psimage->components = spp;
+			psimage->bpc = bps;
+			psimage->colorspace = spp == 1 ? PS_COLORSPACE_INDEXED : PS_COLORSPACE_RGB;
+			return(psimage);
+		}
+
 		if(NULL == (data = read_bmp(psdoc, filename, &w, &h, &bps, &spp, &xres, &yres,
 						 &color_table, &color_table_size, &color_table_elements))) {
 			ps_error(psdoc, PS_MemoryError, _("Could not read bmp file."));
 			psdoc->free(psdoc, psimage);
-			fclose(fp);
-			return(0);
+			return(NULL);
 		}
 		psimage->width = w;
 		psimage->height = h;
@@ -5109,8 +6019,7 @@ PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const c
 			if(NULL == (psimage->palette = psdoc->malloc(psdoc, sizeof(PSColor) * color_table_size, _("Allocate memory for color palette.")))) {
 				ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for color palette."));
 				psdoc->free(psdoc, psimage);
-				fclose(fp);
-				return(0);
+				return(NULL);
 			}
 
 			ct = color_table;
@@ -5134,61 +6043,194 @@ PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const c
 	} else
 #endif
 	if(0 == strncmp("eps", type, 3)) {
-		char *bb;
+		float x, y, width, height;
 		struct stat statbuf;
 		if(0 > stat(filename, &statbuf)) {
 			ps_error(psdoc, PS_RuntimeError, _("Could not stat eps file."));
-			fclose(fp);
-			return(0);
+			return(NULL);
 		}
 		if(NULL == (psimage = (PSImage *) psdoc->malloc(psdoc, sizeof(PSImage), _("Allocate memory for image.")))) {
 			ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for image."));
-			fclose(fp);
-			return(0);
+			return(NULL);
 		}
 		memset(psimage, 0, sizeof(PSImage));
 		psimage->type = ps_strdup(psdoc, type);
 
-		if(NULL == (psimage->data = psdoc->malloc(psdoc, statbuf.st_size+1, _("Allocate memory for image data.")))) {
-			ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for image data."));
-			psdoc->free(psdoc, psimage);
-			fclose(fp);
-			return(0);
-		}
+		/* The file is not read into memory but copied into the
+		 * document when needed. */
+		psimage->filename = ps_strdup(psdoc, filename);
 		psimage->psdoc = psdoc;
 		psimage->length = statbuf.st_size;
 
-		fread(psimage->data, statbuf.st_size, 1, fp);
-		psimage->data[statbuf.st_size] = '\0';
-		bb = strstr(psimage->data, "%%BoundingBox:");
-		if(bb) {
-			float x, y, width, height;
-			bb += 15;
-			sscanf(bb, "%f %f %f %f", &x, &y, &width, &height);
+		if(0 == ps_read_eps_boundingbox(fp, &x, &y, &width, &height)) {
 			psimage->width = (int) width;
 			psimage->height = (int) height;
 		}
 	} else {
 		ps_error(psdoc, PS_RuntimeError, _("Images of type '%s' not supported."), type);
+		return(NULL);
+	}
+
+	return(psimage);
+}
+/* }}} */
+
+/* _ps_decode_image() {{{
+ * Reads the samples of an image opened with the parameter 'imagedecoding'
+ * set to 'lazy' or 'transient' from its file. Returns -1 if the file
+ * cannot be read or does not contain the image opened before.
+ */
+static int
+_ps_decode_image(PSDoc *psdoc, PSImage *image) {
+	PSImage *decoded;
+	FILE *fp;
+
+	if ((fp = fopen(image->filename, "rb")) == NULL) {
+		ps_error(psdoc, PS_RuntimeError, _("Could not open image file %s."), image->filename);
+		return(-1);
+	}
+	decoded = _ps_read_image_file(psdoc, image->type, image->filename, fp, image->ismask ? "mask" : NULL, 0, 0, 0);
+	fclose(fp);
+	if(NULL == decoded)
+		return(-1);
+	if(NULL == decoded->data || decoded->width != image->width || decoded->height != image->height) {
+		ps_error(psdoc, PS_RuntimeError, _("Image file %s has changed since it was opened."), image->filename);
+		_ps_delete_image(psdoc, decoded);
+		return(-1);
+	}
+
+	/* Only the size was known before. The palette and the precise
+	 * format of the samples are taken from the decoded image. */
+	image->components = decoded->components;
+	image->bpc = decoded->bpc;
+	image->colorspace = decoded->colorspace;
+	image->compression = decoded->compression;
+	image->inverted = decoded->inverted;
+	image->data = decoded->data;
+	image->length = decoded->length;
+	if(image->palette)
+		psdoc->free(psdoc, image->palette);
+	image->palette = decoded->palette;
+	image->numcolors = decoded->numcolors;
+	decoded->data = NULL;
+	decoded->palette = NULL;
+	_ps_delete_image(psdoc, decoded);
+	return(0);
+}
+/* }}} */
+
+/* _ps_open_image_file() {{{
+ * Opens an image from a file
+ */
+static int
+_ps_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const char *stringparam, int intparam) {
+	PSImage *psimage;
+	int imageid;
+	const char *imgreuse;
+	FILE *fp;
+	PSDIGEST *imgdigest;
+	unsigned char digest[PS_DIGEST_MAXSIZE];
+	int cacheable = 0;
+	int decoding = PS_DECODE_OPEN;
+	int streamable;
+
+	if(NULL == psdoc) {
+		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
+		return 0;
+	}
+
+	imgreuse = PS_get_parameter(psdoc, "imagereuse", 0.0);
+	if(!imgreuse || strcmp(imgreuse, "true") == 0) {
+		/* If the header is not written, because we are before
+		 * the first page, then output the header first.
+		 */
+		if(psdoc->beginprologwritten == ps_false) {
+			ps_write_ps_comments(psdoc);
+			ps_write_ps_beginprolog(psdoc);
+		}
+
+		if(ps_check_scope(psdoc, PS_SCOPE_DOCUMENT|PS_SCOPE_PAGE)) {
+			ps_error(psdoc, PS_Warning, _("Calling %s between pages or on pages for reusable images may cause problems when viewing the document. Call it before the first page."), "PS_open_image_file");
+		}
+
+		if(!ps_check_scope(psdoc, PS_SCOPE_DOCUMENT|PS_SCOPE_PAGE|PS_SCOPE_PROLOG)) {
+			ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'document' or 'page' scope."), "PS_open_image_file");
+			return 0;
+		}
+	} else {
+		if(!ps_check_scope(psdoc, PS_SCOPE_DOCUMENT|PS_SCOPE_PAGE)) {
+			ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'document' or 'page' scope."), "PS_open_image_file");
+			return 0;
+		}
+		/* The data of reusable images is written right away, any
+		 * other image may be decoded when it is placed */
+		decoding = _ps_image_decoding(psdoc);
+	}
+
+	if(NULL == filename) {
+		ps_error(psdoc, PS_RuntimeError, _("Filename of images is NULL."));
+		return 0;
+	}
+
+	if ((fp = fopen(filename, "rb")) == NULL) {
+		ps_error(psdoc, PS_RuntimeError, _("Could not open image file %s."), filename);
+		return 0;
+	}
+
+	if(NULL == type) {
+		ps_error(psdoc, PS_RuntimeError, _("Type of image is NULL."));
+		return 0;
+	}
+
+	/* The same file may have been opened before. Its content is
+	 * compared, because the file could have changed since then. */
+	if(NULL != (imgdigest = _ps_image_digest_new(psdoc, type, stringparam, intparam))) {
+		char buffer[8192];
+		size_t n;
+		while(0 < (n = fread(buffer, 1, sizeof(buffer), fp)))
+			ps_digest_update(imgdigest, buffer, n);
+		rewind(fp);
+		if(0 != (imageid = _ps_image_cache_get(psdoc, imgdigest, digest))) {
+			fclose(fp);
+			return(imageid);
+		}
+		cacheable = 1;
+	}
+
+	/* png files are only decoded row by row, if the data of reusable
+	 * images is written right now, or if the caller has agreed to keep
+	 * the file until the image is placed by setting 'imagedecoding' */
+	streamable = (!imgreuse || strcmp(imgreuse, "true") == 0 || decoding != PS_DECODE_OPEN);
+	if(NULL == (psimage = _ps_read_image_file(psdoc, type, filename, fp, stringparam, intparam, decoding != PS_DECODE_OPEN, streamable))) {
 		fclose(fp);
 		return(0);
 	}
 	/* close the file */
 	fclose(fp);
 
+	/* Only the header has been read. The samples are read again from
+	 * the file when the image is placed. */
+	if(decoding != PS_DECODE_OPEN && NULL == psimage->data && NULL == psimage->filename) {
+		psimage->filename = ps_strdup(psdoc, filename);
+		psimage->decoding = decoding;
+	}
+
 	/* that's it */
 
 	if(!imgreuse || strcmp(imgreuse, "true") == 0) {
 		char buffer[25];
 		psimage->isreusable = 1;
-		sprintf(buffer, "Imagedata%d", rand());
+		sprintf(buffer, "Imagedata%d", ++psdoc->imagedatacnt);
 		psimage->name = ps_strdup(psdoc, buffer);
 	}
 
 	if(0 == (imageid = _ps_register_image(psdoc, psimage))) {
 		ps_error(psdoc, PS_MemoryError, _("Could not register image."));
 		psdoc->free(psdoc, psimage->type);
-		psdoc->free(psdoc, psimage->data);
+		if(psimage->data)
+			psdoc->free(psdoc, psimage->data);
+		if(psimage->filename)
+			psdoc->free(psdoc, psimage->filename);
 		psdoc->free(psdoc, psimage);
 		return(0);
 	}
@@ -5200,55 +6242,55 @@ PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const c
 			ps_printf(psdoc, "<< /Filter /SubFileDecode\n");
 			ps_printf(psdoc, "   /DecodeParms << /EODCount 0 /EODString (*EOD*) >>\n");
 			ps_printf(psdoc, ">> /ReusableStreamDecode filter\n");
-			ps_write(psdoc, psimage->data, psimage->length);
+			ps_write_eps_file(psdoc, psimage);
 			ps_printf(psdoc, "*EOD*\n");
 			ps_printf(psdoc, "def\n");
+#ifdef HAVE_LIBPNG
+		} else if(psimage->filename) {
+			_ps_write_png_file(psdoc, psimage);
+#endif
 		} else {
-			char *tmpdata;
-			const char *imgenc;
-			int reallength, j;
+			PSImageFilter filter;
 
-			imgenc = PS_get_parameter(psdoc, "imageencoding", 0.0);
+			ps_init_image_filter(psdoc, &filter, _ps_image_colors(psimage), psimage->components, psimage->bpc, psimage->width, psimage->compression, psimage->data, psimage->length);
 			ps_printf(psdoc, "/%s\n", psimage->name);
 			ps_printf(psdoc, "currentfile\n");
-			ps_printf(psdoc, "<< /Filter /ASCII%sDecode >>\n", (imgenc == NULL || strcmp(imgenc, "hex") != 0) ? "85" : "Hex");
-			ps_printf(psdoc, "/ReusableStreamDecode filter\n");
-
-			if(psimage->components == 4 && psimage->colorspace == PS_COLORSPACE_RGB) {
-				char *dataptr, *tmpdataptr;
-				int j;
-				dataptr = psimage->data;
-				reallength = psimage->height*psimage->width*3;
-				tmpdata = tmpdataptr = psdoc->malloc(psdoc, psimage->height*psimage->width*3, _("Allocate memory for temporary image data."));
-				for(j=0; j<psimage->length; j++) {
-					*tmpdataptr++ = *dataptr++;
-					*tmpdataptr++ = *dataptr++;
-					*tmpdataptr++ = *dataptr++;
-					dataptr++;
-				}
-			} else {
-				tmpdata = psimage->data;
-				reallength = psimage->length;
-			}
-			if(imgenc == NULL || strcmp(imgenc, "hex") != 0)
-				ps_ascii85_encode(psdoc, tmpdata, reallength);
-			else
-				ps_asciihex_encode(psdoc, tmpdata, reallength);
-			if(psimage->components == 4 && psimage->colorspace == PS_COLORSPACE_RGB)
-				psdoc->free(psdoc, tmpdata);
+			ps_puts(psdoc, "<< ");
+			ps_write_image_filter(psdoc, &filter);
+			ps_puts(psdoc, " >>\n");
+			ps_write_image_data(psdoc, &filter, "/ReusableStreamDecode filter\n");
 
 			ps_printf(psdoc, "\ndef\n");
 		}
 	}
+	psimage->refcount = 1;
+	if(cacheable)
+		_ps_image_cache_put(psdoc, psimage, digest);
 	return(imageid);
 }
 /* }}} */
 
-/* PS_place_image() {{{
+/* PS_open_image_file() {{{
+ * Calls _ps_open_image_file() and measures the time spent in it
+ */
+PSLIB_API int PSLIB_CALL
+PS_open_image_file(PSDoc *psdoc, const char *type, const char *filename, const char *stringparam, int intparam) {
+	int imageid, category;
+
+	ps_stats_start_timer(psdoc, PS_STATS_TIME_IMAGE);
+	category = ps_set_stats_category(psdoc, PS_STATS_IMAGE);
+	imageid = _ps_open_image_file(psdoc, type, filename, stringparam, intparam);
+	ps_set_stats_category(psdoc, category);
+	ps_stats_stop_timer(psdoc, PS_STATS_TIME_IMAGE);
+	return(imageid);
+}
+/* }}} */
+
+/* _ps_place_image() {{{
  * Place an image on the page
  */
-PSLIB_API void PSLIB_CALL
-PS_place_image(PSDoc *psdoc, int imageid, float x, float y, float scale) {
+static void
+_ps_place_image(PSDoc *psdoc, int imageid, float x, float y, float scale) {
 	PSImage *image;
 	const char *imgreuse;
 	
@@ -5256,21 +6298,29 @@ PS_place_image(PSDoc *psdoc, int imageid, float x, float y, float scale) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	imgreuse = PS_get_parameter(psdoc, "imagereuse", 0.0);
-	if(!imgreuse || strcmp(imgreuse, "true") == 0) {
+	if(ps_check_scope(psdoc, PS_SCOPE_IMAGE)) {
+		/* An image begun with PS_begin_image() which is not reusable is
+		 * placed before its rows are written */
+		if(imageid != psdoc->imagestream->imageid || psdoc->imagestream->image->isreusable || psdoc->imagestream->placed) {
+			ps_error(psdoc, PS_RuntimeError, _("Only the image being written may be placed before calling %s."), "PS_end_image");
+			return;
+		}
+	} else if(!imgreuse || strcmp(imgreuse, "true") == 0) {
 		if(!ps_check_scope(psdoc, PS_SCOPE_PAGE|PS_SCOPE_TEMPLATE)) {
-			ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page' or 'template' scope."), __FUNCTION__);
+			ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page' or 'template' scope."), "PS_place_image");
 			return;
 		}
 	} else {
 		if(!ps_check_scope(psdoc, PS_SCOPE_PAGE)) {
-			ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page' scope."), __FUNCTION__);
+			ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page' scope."), "PS_place_image");
 			return;
 		}
 	}
 
 	if(scale == 0.0) {
-		ps_error(psdoc, PS_Warning, _("Scaling image to 0.0 will make it disappear."), __FUNCTION__);
+		ps_error(psdoc, PS_Warning, _("Scaling image to 0.0 will make it disappear."), "PS_place_image");
 	}
 
 	image = _ps_get_image(psdoc, imageid);
@@ -5283,8 +6333,16 @@ PS_place_image(PSDoc *psdoc, int imageid, float x, float y, float scale) {
 		return;
 	}
 
-	/* All images must have data, except for templates */
-	if(NULL == image->data && strcmp(image->type, "template")) {
+	/* The file of an image opened for lazy decoding is read now */
+	if(image->decoding != PS_DECODE_OPEN && NULL == image->data) {
+		if(0 != _ps_decode_image(psdoc, image))
+			return;
+	}
+
+	/* All images must have data, except for templates, eps files,
+	 * reusable images and images whose rows are written after placing
+	 * them */
+	if(NULL == image->data && NULL == image->filename && !image->isreusable && strcmp(image->type, "template") && !ps_check_scope(psdoc, PS_SCOPE_IMAGE)) {
 		ps_error(psdoc, PS_RuntimeError, _("Image has no data."));
 		return;
 	}
@@ -5296,6 +6354,7 @@ PS_place_image(PSDoc *psdoc, int imageid, float x, float y, float scale) {
 #ifdef HAVE_LIBJPEG
 		0 == strncmp(image->type, "jpeg", 4) ||
 #endif
+		image->compression == PS_IMAGECOMP_DCT ||
 #ifdef HAVE_LIBGIF
 		0 == strncmp(image->type, "gif", 3) ||
 #endif
@@ -5307,8 +6366,11 @@ PS_place_image(PSDoc *psdoc, int imageid, float x, float y, float scale) {
 #endif
 		0 == strncmp(image->type, "memory", 6) ) {
 		unsigned char *dataptr, *tmpdata, *tmpdataptr;
-		const char *imgenc;
-		int i, j, k, reallength;
+		PSImageFilter filter;
+		int i, j, k;
+#ifdef LEVEL1
+		unsigned char *rowptr;
+#endif
 		ps_printf(psdoc, "gsave\n");
 #ifdef LEVEL1
 		ps_printf(psdoc, "%.2f %.2f scale\n", scale*image->width, scale*image->height);
@@ -5323,25 +6385,31 @@ PS_place_image(PSDoc *psdoc, int imageid, float x, float y, float scale) {
 		ps_printf(psdoc, "{ bpicstr readstring }\n");
 		ps_printf(psdoc, "true %d\n", image->components);
 		ps_printf(psdoc, "colorimage\n");
-		rowptr = image->data;
-		dataptr = image->data;
+		/* Each component of a row is collected and written at once */
+		tmpdata = psdoc->malloc(psdoc, image->width, _("Allocate memory for temporary image data."));
+		if(NULL == tmpdata) {
+			ps_printf(psdoc, "grestore\n");
+			return;
+		}
+		rowptr = (unsigned char *) image->data;
 		for(j=0; j<image->height; j++) {
 			for(k=0; k<image->components; k++) {
 				dataptr = rowptr+k;
+				tmpdataptr = tmpdata;
 				for(i=0; i<image->width; i++) {
-					ps_printf(psdoc, "%02x", *dataptr);
-					dataptr += 3;
+					*tmpdataptr++ = *dataptr;
+					dataptr += image->components;
 				}
+				ps_write_hex(psdoc, tmpdata, image->width, 0);
 				ps_printf(psdoc, "\n");
 			}
 			rowptr += image->components*image->width;
 		}
+		psdoc->free(psdoc, tmpdata);
 #else
 		ps_printf(psdoc, "%.2f %.2f translate\n", x, y);
 		ps_printf(psdoc, "%.2f %.2f scale\n", scale*image->width, scale*image->height);
 
-		imgenc = PS_get_parameter(psdoc, "imageencoding", 0.0);
-
 		if(image->isreusable)
 			ps_printf(psdoc, "%s 0 setfileposition\n", image->name);
 			
@@ -5386,7 +6454,12 @@ PS_place_image(PSDoc *psdoc, int imageid, float x, float y, float scale) {
 					ps_printf(psdoc, "  /Decode [0 1 0 1 0 1]\n");
 					break;
 				case PS_COLORSPACE_CMYK:
-					ps_printf(psdoc, "  /Decode [1 0 1 0 1 0 1 0]\n");
+					/* Only jpeg files written by Adobe contain inverted cmyk
+					 * data. Decoded images are always treated as inverted. */
+					if(image->compression == PS_IMAGECOMP_DCT && !image->inverted)
+						ps_printf(psdoc, "  /Decode [0 1 0 1 0 1 0 1]\n");
+					else
+						ps_printf(psdoc, "  /Decode [1 0 1 0 1 0 1 0]\n");
 					break;
 				case PS_COLORSPACE_INDEXED:
 					ps_printf(psdoc, "  /Decode [0 %d]\n", (int) pow(2,image->bpc)-1);
@@ -5396,29 +6469,21 @@ PS_place_image(PSDoc *psdoc, int imageid, float x, float y, float scale) {
 			if(image->isreusable) {
 				ps_printf(psdoc, "  /DataSource %s\n", image->name);
 				ps_printf(psdoc, ">> image\n");
+#ifdef HAVE_LIBPNG
+			} else if(image->filename && image->decoding == PS_DECODE_OPEN) {
+				_ps_write_png_file(psdoc, image);
+#endif
+			} else if(NULL == image->data) {
+				/* The data source follows with the first rows, the
+				 * graphic state is restored by PS_end_image() */
+				psdoc->imagestream->placed = ps_true;
+				return;
 			} else {
-				ps_printf(psdoc, "  /DataSource currentfile /ASCII%sDecode filter\n", (imgenc == NULL || strcmp(imgenc, "hex") != 0) ? "85" : "Hex");
-				ps_printf(psdoc, ">> image\n");
-				if(image->components == 4 && image->colorspace == PS_COLORSPACE_RGB) {
-					dataptr = image->data;
-					reallength = image->height*image->width*3;
-					tmpdata = tmpdataptr = psdoc->malloc(psdoc, image->height*image->width*3, _("Allocate memory for temporary image data."));
-					for(j=0; j<image->length; j++) {
-						*tmpdataptr++ = *dataptr++;
-						*tmpdataptr++ = *dataptr++;
-						*tmpdataptr++ = *dataptr++;
-						dataptr++;
-					}
-				} else {
-					tmpdata = image->data;
-					reallength = image->length;
-				}
-				if(imgenc == NULL || strcmp(imgenc, "hex") != 0)
-					ps_ascii85_encode(psdoc, tmpdata, reallength);
-				else
-					ps_asciihex_encode(psdoc, tmpdata, reallength);
-				if(image->components == 4 && image->colorspace == PS_COLORSPACE_RGB)
-					psdoc->free(psdoc, tmpdata);
+				ps_init_image_filter(psdoc, &filter, _ps_image_colors(image), image->components, image->bpc, image->width, image->compression, image->data, image->length);
+				ps_puts(psdoc, "  /DataSource ");
+				ps_write_image_datasource(psdoc, &filter);
+				ps_putc(psdoc, '\n');
+				ps_write_image_data(psdoc, &filter, ">> image\n");
 			}
 		} else {
 			/* Output the image mask */
@@ -5430,8 +6495,6 @@ PS_place_image(PSDoc *psdoc, int imageid, float x, float y, float scale) {
 				ps_printf(psdoc, "  /BitsPerComponent 1\n");
 				ps_printf(psdoc, "  /Decode [0 1]\n");
 				ps_printf(psdoc, "  /ImageMatrix [%d 0 0 %d 0 %d]\n", image->width, -image->height, image->height);
-				ps_printf(psdoc, "  /DataSource currentfile /ASCII%sDecode filter\n", (imgenc == NULL || strcmp(imgenc, "hex") != 0) ? "85" : "Hex");
-				ps_printf(psdoc, ">> imagemask\n");
 				dataptr = image->data;
 				tmpdata = tmpdataptr = psdoc->malloc(psdoc, (image->height*image->width/8)+1, _("Allocate memory for temporary image data."));
 				i = 0;
@@ -5458,63 +6521,335 @@ PS_place_image(PSDoc *psdoc, int imageid, float x, float y, float scale) {
 					*tmpdataptr = *tmpdataptr << (8-i);
 					k++;
 				}
-				if(imgenc == NULL || strcmp(imgenc, "hex") != 0)
-					ps_ascii85_encode(psdoc, tmpdata, k);
-				else
-					ps_asciihex_encode(psdoc, tmpdata, k);
+				ps_init_image_filter(psdoc, &filter, 1, 1, 1, image->width, PS_IMAGECOMP_NONE, (char *) tmpdata, k);
+				ps_puts(psdoc, "  /DataSource ");
+				ps_write_image_datasource(psdoc, &filter);
+				ps_putc(psdoc, '\n');
+				ps_write_image_data(psdoc, &filter, ">> imagemask\n");
 				psdoc->free(psdoc, tmpdata);
 				ps_printf(psdoc, "\n");
 			}
 		}
 
-#endif
-		ps_printf(psdoc, "\n");
-		ps_printf(psdoc, "grestore\n");
-	} else if(0 == strncmp(image->type, "eps", 3)) {
-		PS_save(psdoc);
-		if(image->isreusable) {
-			PS_translate(psdoc, x, y);
-			PS_scale(psdoc, scale, scale);
-			ps_printf(psdoc, "/showpage{}N/erasepage{}N/copypage{}N\n");
-			ps_printf(psdoc, "%s 0 setfileposition %s cvx exec\n", image->name, image->name);
-		} else {
-			ps_printf(psdoc, "/showpage{}N/erasepage{}N/copypage{}N\n");
-			PS_translate(psdoc, x, y);
-			PS_scale(psdoc, scale, scale);
-			ps_write(psdoc, image->data, image->length);
+#endif
+		ps_printf(psdoc, "\n");
+		ps_printf(psdoc, "grestore\n");
+
+		/* The samples are decoded again for the next placement */
+		if(image->decoding == PS_DECODE_TRANSIENT) {
+			psdoc->free(psdoc, image->data);
+			image->data = NULL;
+		}
+	} else if(0 == strncmp(image->type, "eps", 3)) {
+		PS_save(psdoc);
+		if(image->isreusable) {
+			PS_translate(psdoc, x, y);
+			PS_scale(psdoc, scale, scale);
+			ps_printf(psdoc, "/showpage{}N/erasepage{}N/copypage{}N\n");
+			ps_printf(psdoc, "%s 0 setfileposition %s cvx exec\n", image->name, image->name);
+		} else {
+			ps_printf(psdoc, "/showpage{}N/erasepage{}N/copypage{}N\n");
+			PS_translate(psdoc, x, y);
+			PS_scale(psdoc, scale, scale);
+			if(image->filename)
+				ps_write_eps_file(psdoc, image);
+			else
+				ps_write(psdoc, image->data, image->length);
+		}
+		PS_restore(psdoc);
+	} else if(0 == strcmp(image->type, "template")) {
+		PS_save(psdoc);
+		PS_translate(psdoc, x, y);
+		PS_scale(psdoc, scale, scale);
+		ps_printf(psdoc, "/%s /Form findresource execform\n", image->name);
+//		ps_printf(psdoc, "%s\n", image->name);
+		PS_restore(psdoc);
+	} else {
+		ps_error(psdoc, PS_RuntimeError, _("Images of type '%s' not supported."), image->type);
+	}
+	return;
+}
+/* }}} */
+
+/* PS_place_image() {{{
+ * Calls _ps_place_image() and measures the time spent in it
+ */
+PSLIB_API void PSLIB_CALL
+PS_place_image(PSDoc *psdoc, int imageid, float x, float y, float scale) {
+	int category;
+
+	ps_stats_start_timer(psdoc, PS_STATS_TIME_IMAGE);
+	category = ps_set_stats_category(psdoc, PS_STATS_IMAGE);
+	_ps_place_image(psdoc, imageid, x, y, scale);
+	ps_set_stats_category(psdoc, category);
+	ps_stats_stop_timer(psdoc, PS_STATS_TIME_IMAGE);
+}
+/* }}} */
+
+/* PS_close_image() {{{
+ * Free the memory used by an image. An image returned by the image
+ * cache is freed when it has been closed as often as it was opened.
+ */
+PSLIB_API void PSLIB_CALL
+PS_close_image(PSDoc *psdoc, int imageid) {
+	PSImage *image;
+
+	if(NULL == psdoc) {
+		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
+		return;
+	}
+
+	/*
+	if(!ps_check_scope(psdoc, PS_SCOPE_DOCUMENT|PS_SCOPE_PAGE)) {
+		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'document' or 'page' scope."), __FUNCTION__);
+		return;
+	}
+	*/
+
+	if(imageid > 0 && imageid <= psdoc->imagecnt && NULL != (image = psdoc->images[imageid-1])) {
+		if(image->refcount > 1) {
+			image->refcount--;
+			return;
+		}
+		if(image->cached)
+			ght_remove(psdoc->imagecache, PS_DIGEST_MAXSIZE, image->digest);
+	}
+	_ps_unregister_image(psdoc, imageid);
+}
+/* }}} */
+
+/* PS_begin_image() {{{
+ * Starts an image whose samples are passed with PS_write_image_rows()
+ * and which is finished with PS_end_image(). The rows are encoded and
+ * written as they come in, so only the rows passed at once are held in
+ * memory. A reusable image can be placed after PS_end_image(), any
+ * other image must be placed on the page before its rows are written.
+ */
+PSLIB_API int PSLIB_CALL
+PS_begin_image(PSDoc *psdoc, int width, int height, int components, int bpc) {
+	PSImage *psimage;
+	PSImageStream *stream;
+	int imageid;
+	const char *imgreuse;
+
+	if(NULL == psdoc) {
+		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
+		return(0);
+	}
+
+	imgreuse = PS_get_parameter(psdoc, "imagereuse", 0.0);
+	if(!imgreuse || strcmp(imgreuse, "true") == 0) {
+		if(psdoc->beginprologwritten == ps_false) {
+			ps_write_ps_comments(psdoc);
+			ps_write_ps_beginprolog(psdoc);
+		}
+
+		if(ps_check_scope(psdoc, PS_SCOPE_DOCUMENT|PS_SCOPE_PAGE)) {
+			ps_error(psdoc, PS_Warning, _("Calling %s between pages or on pages for reusable images may cause problems when viewing the document. Call it before the first page."), __FUNCTION__);
+		}
+
+		if(!ps_check_scope(psdoc, PS_SCOPE_DOCUMENT|PS_SCOPE_PAGE|PS_SCOPE_PROLOG)) {
+			ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'document' or 'page' scope."), __FUNCTION__);
+			return(0);
 		}
-		PS_restore(psdoc);
-	} else if(0 == strcmp(image->type, "template")) {
-		PS_save(psdoc);
-		PS_translate(psdoc, x, y);
-		PS_scale(psdoc, scale, scale);
-		ps_printf(psdoc, "/%s /Form findresource execform\n", image->name);
-//		ps_printf(psdoc, "%s\n", image->name);
-		PS_restore(psdoc);
 	} else {
-		ps_error(psdoc, PS_RuntimeError, _("Images of type '%s' not supported."), image->type);
+		if(!ps_check_scope(psdoc, PS_SCOPE_PAGE)) {
+			ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page' scope."), __FUNCTION__);
+			return(0);
+		}
 	}
-	return;
+
+	if(width <= 0 || height <= 0) {
+		ps_error(psdoc, PS_RuntimeError, _("Image must have a positive width and height."));
+		return(0);
+	}
+
+	if(bpc != 1 && bpc != 2 && bpc != 4 && bpc != 8) {
+		ps_error(psdoc, PS_RuntimeError, _("Image must have 1, 2, 4 or 8 bits per component."));
+		return(0);
+	}
+
+	if(NULL == (psimage = (PSImage *) psdoc->malloc(psdoc, sizeof(PSImage), _("Allocate memory for image.")))) {
+		ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for image."));
+		return(0);
+	}
+	memset(psimage, 0, sizeof(PSImage));
+	switch(components) {
+		case 1:
+			psimage->colorspace = PS_COLORSPACE_GRAY;
+			break;
+		case 3:
+			psimage->colorspace = PS_COLORSPACE_RGB;
+			break;
+		case 4:
+			psimage->colorspace = PS_COLORSPACE_CMYK;
+			break;
+		default:
+			ps_error(psdoc, PS_RuntimeError, _("Image has unknown number of components per pixel."));
+			psdoc->free(psdoc, psimage);
+			return(0);
+	}
+
+	if(NULL == (stream = (PSImageStream *) psdoc->malloc(psdoc, sizeof(PSImageStream), _("Allocate memory for image stream.")))) {
+		ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for image stream."));
+		psdoc->free(psdoc, psimage);
+		return(0);
+	}
+	memset(stream, 0, sizeof(PSImageStream));
+
+	stream->rowbytes = ((size_t) width * components * bpc + 7) / 8;
+	psimage->width = width;
+	psimage->height = height;
+	psimage->components = components;
+	psimage->bpc = bpc;
+	psimage->length = stream->rowbytes * height;
+	psimage->type = ps_strdup(psdoc, "memory");
+	if(!imgreuse || strcmp(imgreuse, "true") == 0) {
+		char buffer[25];
+		psimage->isreusable = 1;
+		sprintf(buffer, "Imagedata%d", ++psdoc->imagedatacnt);
+		psimage->name = ps_strdup(psdoc, buffer);
+	}
+
+	if(0 == (imageid = _ps_register_image(psdoc, psimage))) {
+		ps_error(psdoc, PS_MemoryError, _("Could not register image."));
+		if(psimage->name)
+			psdoc->free(psdoc, psimage->name);
+		psdoc->free(psdoc, psimage->type);
+		psdoc->free(psdoc, psimage);
+		psdoc->free(psdoc, stream);
+		return(0);
+	}
+	psimage->refcount = 1;
+
+	stream->image = psimage;
+	stream->imageid = imageid;
+	psdoc->imagestream = stream;
+	ps_enter_scope(psdoc, PS_SCOPE_IMAGE);
+
+	return(imageid);
 }
 /* }}} */
 
-/* PS_close_image() {{{
- * Free the memory used by an image
+/* _ps_write_image_rows() {{{
+ * Encodes rows of the image begun with PS_begin_image(). The code
+ * reading the data is output with the first rows, whose samples are
+ * also used for choosing the encoding.
+ */
+static void
+_ps_write_image_rows(PSDoc *psdoc, const char *data, int rows) {
+	PSImageStream *stream;
+	PSImage *image;
+
+	if(NULL == psdoc) {
+		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
+		return;
+	}
+
+	if(!ps_check_scope(psdoc, PS_SCOPE_IMAGE)) {
+		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'image' scope."), "PS_write_image_rows");
+		return;
+	}
+
+	stream = psdoc->imagestream;
+	image = stream->image;
+	if(!image->isreusable && !stream->placed) {
+		ps_error(psdoc, PS_RuntimeError, _("Image must be placed before its rows are written."));
+		return;
+	}
+	if(rows > image->height - stream->rows) {
+		ps_error(psdoc, PS_Warning, _("Image has only %d rows, the remaining rows are ignored."), image->height);
+		rows = image->height - stream->rows;
+	}
+	if(rows <= 0 || NULL == data)
+		return;
+
+	if(!stream->started) {
+		ps_init_image_stream(psdoc, &stream->filter, image->components, image->bpc, image->width, PS_IMAGECOMP_NONE, data, rows * stream->rowbytes, image->length);
+		_ps_write_image_header(psdoc, image, &stream->filter);
+		stream->started = ps_true;
+	}
+	ps_write_image_stream(psdoc, &stream->filter, data, rows * stream->rowbytes);
+	stream->rows += rows;
+}
+/* }}} */
+
+/* PS_write_image_rows() {{{
+ * Calls _ps_write_image_rows() and measures the time spent in it
  */
 PSLIB_API void PSLIB_CALL
-PS_close_image(PSDoc *psdoc, int imageid) {
+PS_write_image_rows(PSDoc *psdoc, const char *data, int rows) {
+	int category;
+
+	ps_stats_start_timer(psdoc, PS_STATS_TIME_IMAGE);
+	category = ps_set_stats_category(psdoc, PS_STATS_IMAGE);
+	_ps_write_image_rows(psdoc, data, rows);
+	ps_set_stats_category(psdoc, category);
+	ps_stats_stop_timer(psdoc, PS_STATS_TIME_IMAGE);
+}
+/* }}} */
+
+/* _ps_end_image() {{{
+ * Finishes the image begun with PS_begin_image(). Missing rows are
+ * filled with zeros.
+ */
+static void
+_ps_end_image(PSDoc *psdoc) {
+	PSImageStream *stream;
+	PSImage *image;
+	char *row;
+
 	if(NULL == psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
-	/*
-	if(!ps_check_scope(psdoc, PS_SCOPE_DOCUMENT|PS_SCOPE_PAGE)) {
-		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'document' or 'page' scope."), __FUNCTION__);
+
+	if(!ps_check_scope(psdoc, PS_SCOPE_IMAGE)) {
+		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'image' scope."), "PS_end_image");
 		return;
 	}
-	*/
 
-	_ps_unregister_image(psdoc, imageid);
+	stream = psdoc->imagestream;
+	image = stream->image;
+	if(!image->isreusable && !stream->placed) {
+		ps_error(psdoc, PS_Warning, _("Image has not been placed."));
+	} else if(stream->rows < image->height) {
+		ps_error(psdoc, PS_Warning, _("Image has %d rows but only %d were written, the remaining rows are filled with zeros."), image->height, stream->rows);
+		if(NULL != (row = psdoc->malloc(psdoc, stream->rowbytes, _("Allocate memory for image row.")))) {
+			memset(row, 0, stream->rowbytes);
+			while(stream->rows < image->height)
+				_ps_write_image_rows(psdoc, row, 1);
+			psdoc->free(psdoc, row);
+		}
+	}
+
+	if(stream->started) {
+		_ps_write_image_trailer(psdoc, image, &stream->filter);
+		if(!image->isreusable) {
+			ps_printf(psdoc, "\n");
+			ps_printf(psdoc, "grestore\n");
+		}
+	} else if(stream->placed)
+		ps_printf(psdoc, "grestore\n");
+
+	psdoc->free(psdoc, stream);
+	psdoc->imagestream = NULL;
+	ps_leave_scope(psdoc, PS_SCOPE_IMAGE);
+}
+/* }}} */
+
+/* PS_end_image() {{{
+ * Calls _ps_end_image() and measures the time spent in it
+ */
+PSLIB_API void PSLIB_CALL
+PS_end_image(PSDoc *psdoc) {
+	int category;
+
+	ps_stats_start_timer(psdoc, PS_STATS_TIME_IMAGE);
+	category = ps_set_stats_category(psdoc, PS_STATS_IMAGE);
+	_ps_end_image(psdoc);
+	ps_set_stats_category(psdoc, category);
+	ps_stats_stop_timer(psdoc, PS_STATS_TIME_IMAGE);
 }
 /* }}} */
 
@@ -5532,6 +6867,8 @@ PS_begin_template(PSDoc *psdoc, float width, float height) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return(0);
 	}
+
+	ps_set_stats_category(psdoc, PS_STATS_OTHER);
 	/* If the header is not written, because we are before
 	 * the first page, then output the header first.
 	 */
@@ -5588,6 +6925,7 @@ PS_end_template(PSDoc *psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_TEMPLATE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'template' scope."), __FUNCTION__);
 		return;
@@ -5614,6 +6952,8 @@ PS_begin_pattern(PSDoc *psdoc, float width, float height, float xstep, float yst
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return(0);
 	}
+
+	ps_set_stats_category(psdoc, PS_STATS_OTHER);
 	if(painttype < 1 || painttype > 2) {
 		ps_error(psdoc, PS_RuntimeError, _("Painttype must be 1 or 2."));
 		return(0);
@@ -5678,6 +7018,7 @@ PS_end_pattern(PSDoc *psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PATTERN)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'pattern' scope."), __FUNCTION__);
 		return;
@@ -5696,7 +7037,7 @@ PSLIB_API int PSLIB_CALL
 PS_shading_pattern(PSDoc *psdoc, int shading, const char *optlist) {
 	PSPattern *pspattern;
 	char buffer[20];
-	int patternid;
+	int patternid, category;
 	PSShading *psshading;
 
 	buffer[0] = '\0';
@@ -5704,6 +7045,7 @@ PS_shading_pattern(PSDoc *psdoc, int shading, const char *optlist) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return 0;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_DOCUMENT|PS_SCOPE_PAGE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'document' or 'page' scope."), __FUNCTION__);
 		return 0;
@@ -5730,10 +7072,12 @@ PS_shading_pattern(PSDoc *psdoc, int shading, const char *optlist) {
 	pspattern->name = ps_strdup(psdoc, buffer);
 	pspattern->painttype = 1;
 
+	category = ps_set_stats_category(psdoc, PS_STATS_OTHER);
 	ps_printf(psdoc, "<< /PatternType 2 ", buffer);
 	ps_printf(psdoc, "  /Shading\n", buffer);
 	ps_output_shading_dict(psdoc, psshading);
 	ps_printf(psdoc, ">> matrix makepattern /%s exch def\n", pspattern->name);
+	ps_set_stats_category(psdoc, category);
 	return(patternid);
 }
 /* }}} */
@@ -5753,6 +7097,7 @@ PS_shading(PSDoc *psdoc, const char *shtype, float x0, float y0, float x1, float
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return(0);
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_DOCUMENT|PS_SCOPE_PAGE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'document' or 'page' scope."), __FUNCTION__);
 		return(0);
@@ -5872,6 +7217,8 @@ PS_begin_font(PSDoc *psdoc, const char *fontname, int reserverd, double a, doubl
 		return(0);
 	}
 
+	ps_set_stats_category(psdoc, PS_STATS_FONT);
+
 	/* If the header is not written, because we are before
 	 * the first page, then output the header first.
 	 */
@@ -5961,6 +7308,7 @@ PS_end_font(PSDoc *psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_FONT)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'font' scope."), __FUNCTION__);
 		return;
@@ -5971,6 +7319,7 @@ PS_end_font(PSDoc *psdoc) {
 	ps_printf(psdoc, "  currentdict\n");
 	ps_printf(psdoc, "end\n");
 	ps_printf(psdoc, "/%s exch definefont pop\n", psfont->metrics->fontname);
+	ps_set_stats_category(psdoc, PS_STATS_OTHER);
 
 	ps_leave_scope(psdoc, PS_SCOPE_FONT);
 }
@@ -5988,6 +7337,7 @@ PS_begin_glyph(PSDoc *psdoc, const char *glyphname, double wx, double llx, doubl
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return 0;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_FONT)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'font' scope."), __FUNCTION__);
 		return 0;
@@ -6032,6 +7382,7 @@ PS_end_glyph(PSDoc *psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_GLYPH)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'glyph' scope."), __FUNCTION__);
 		return;
@@ -6055,6 +7406,7 @@ PS_add_kerning(PSDoc *psdoc, int fontid, const char *glyphname1, const char *gly
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_FONT)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'font' scope."), __FUNCTION__);
 		return;
@@ -6096,6 +7448,7 @@ PS_add_ligature(PSDoc *psdoc, int fontid, const char *glyphname1, const char *gl
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_FONT)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'font' scope."), __FUNCTION__);
 		return;
@@ -6141,6 +7494,7 @@ PS_get_buffer(PSDoc *psdoc, long *size) {
 		*size = 0;
 		return(NULL);
 	}
+	ps_flush(psdoc);
 	*size = str_buffer_len(psdoc, psdoc->sb);	
 	tmp = str_buffer_get(psdoc, psdoc->sb);
 	str_buffer_clear(psdoc, psdoc->sb);
@@ -6148,6 +7502,197 @@ PS_get_buffer(PSDoc *psdoc, long *size) {
 }
 /* }}} */
 
+/* PS_get_buffer_chunks() {{{
+ * Returns the content of the memory buffer as a list of chunks without
+ * copying it into one contiguous block. Returns the number of chunks.
+ * If chunks is NULL or maxchunks is less than the number of chunks,
+ * only the number is returned and the buffer is left untouched.
+ * Otherwise chunks is filled and the buffer is cleared. The data
+ * stays valid until the next call of a pslib function.
+ */
+PSLIB_API int PSLIB_CALL
+PS_get_buffer_chunks(PSDoc *psdoc, PSBufferChunk *chunks, int maxchunks) {
+	int count;
+	if(NULL == psdoc) {
+		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
+		return(-1);
+	}
+	if(NULL == psdoc->sb) {
+		return(0);
+	}
+	ps_flush(psdoc);
+	count = str_buffer_get_chunks(psdoc->sb, chunks, maxchunks);
+	if(NULL != chunks && count <= maxchunks)
+		str_buffer_clear(psdoc, psdoc->sb);
+	return(count);
+}
+/* }}} */
+
+/* PS_drain_buffer_chunks() {{{
+ * Returns up to maxchunks pieces of the memory buffer which are complete
+ * and removes them from the buffer. Complete are all pages finished with
+ * PS_end_page() and everything written before. The function can be
+ * called while the document is still being created. Returns the number of
+ * pieces which is 0 if there is no complete data. The data stays valid
+ * until the next call of this function, PS_get_buffer() or
+ * PS_get_buffer_chunks().
+ */
+PSLIB_API int PSLIB_CALL
+PS_drain_buffer_chunks(PSDoc *psdoc, PSBufferChunk *chunks, int maxchunks) {
+	if(NULL == psdoc) {
+		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
+		return(-1);
+	}
+	if(NULL == chunks || maxchunks <= 0) {
+		ps_error(psdoc, PS_RuntimeError, _("No space for returning chunks."));
+		return(-1);
+	}
+	if(NULL == psdoc->sb) {
+		return(0);
+	}
+	return(str_buffer_drain(psdoc->sb, chunks, maxchunks));
+}
+/* }}} */
+
+/* PS_flush() {{{
+ * Passes the content of the internal output buffer to the write procedure.
+ * If the document is written into a file, the file will be flushed as well.
+ */
+PSLIB_API void PSLIB_CALL
+PS_flush(PSDoc *psdoc) {
+	if(NULL == psdoc) {
+		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
+		return;
+	}
+	if(NULL == psdoc->writeproc) {
+		ps_error(psdoc, PS_RuntimeError, _("Document has not been opened."));
+		return;
+	}
+	ps_flush(psdoc);
+	if(psdoc->deflater)
+		ps_deflater_flush(psdoc, psdoc->deflater);
+	if(psdoc->writer)
+		ps_writer_sync(psdoc, psdoc->writer);
+	if(psdoc->fp)
+		fflush(psdoc->fp);
+}
+/* }}} */
+
+/* PS_get_stats() {{{
+ * Fills stats with the statistics of the document created so far.
+ * The byte counts do not include compression and the data still in
+ * the output buffer is counted as well. Returns 0 on success and -1
+ * in case of an error.
+ */
+PSLIB_API int PSLIB_CALL
+PS_get_stats(PSDoc *psdoc, PSStats *stats) {
+	if(NULL == psdoc) {
+		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
+		return(-1);
+	}
+	if(NULL == stats) {
+		ps_error(psdoc, PS_RuntimeError, _("Pointer to statistics is null."));
+		return(-1);
+	}
+	memcpy(stats, &(psdoc->stats), sizeof(PSStats));
+	stats->size = ps_tell(psdoc);
+	stats->bytes[psdoc->statcategory] += stats->size - psdoc->statcategorystart;
+	return(0);
+}
+/* }}} */
+
+/* PS_get_page_stats() {{{
+ * Fills stats with the position and size of a page. The first page
+ * has number 1. The size of a page which has not been ended yet is the
+ * number of bytes output so far. Returns -1 if the page does not exist.
+ */
+PSLIB_API int PSLIB_CALL
+PS_get_page_stats(PSDoc *psdoc, int page, PSPageStats *stats) {
+	if(NULL == psdoc) {
+		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
+		return(-1);
+	}
+	if(NULL == stats) {
+		ps_error(psdoc, PS_RuntimeError, _("Pointer to statistics is null."));
+		return(-1);
+	}
+	if(page < 1 || page > (int) psdoc->page || page > psdoc->pagestatssize) {
+		ps_error(psdoc, PS_Warning, _("Page %d does not exist."), page);
+		return(-1);
+	}
+	stats->offset = psdoc->pagestats[page-1].offset;
+	if(page == (int) psdoc->page && psdoc->page_open == ps_true)
+		stats->size = ps_tell(psdoc) - stats->offset;
+	else
+		stats->size = psdoc->pagestats[page-1].size;
+	return(0);
+}
+/* }}} */
+
+/* PS_get_index() {{{
+ * Fills index with the positions of the prolog, the setup and the
+ * trailer of the document. The positions of the pages can be retrieved
+ * with PS_get_page_stats(). Returns 0 on success and -1 in case of an
+ * error.
+ */
+PSLIB_API int PSLIB_CALL
+PS_get_index(PSDoc *psdoc, PSDocIndex *index) {
+	if(NULL == psdoc) {
+		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
+		return(-1);
+	}
+	if(NULL == index) {
+		ps_error(psdoc, PS_RuntimeError, _("Pointer to index is null."));
+		return(-1);
+	}
+	memcpy(index, &(psdoc->index), sizeof(PSDocIndex));
+	index->size = ps_tell(psdoc);
+	index->pages = (int) psdoc->page;
+	return(0);
+}
+/* }}} */
+
+/* PS_get_digest() {{{
+ * Copies the checksum of a page or, if page is 0, of the whole document
+ * into digest, which must have room for PS_DIGEST_MAXSIZE bytes.
+ * Returns the number of bytes of the checksum or -1 if it is not
+ * available.
+ */
+PSLIB_API int PSLIB_CALL
+PS_get_digest(PSDoc *psdoc, int page, unsigned char *digest) {
+	int size;
+
+	if(NULL == psdoc) {
+		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
+		return(-1);
+	}
+	if(NULL == digest) {
+		ps_error(psdoc, PS_RuntimeError, _("Pointer to digest is null."));
+		return(-1);
+	}
+	if(psdoc->digesttype == PS_DIGEST_NONE) {
+		ps_error(psdoc, PS_RuntimeError, _("Checksums are not computed. Set the parameter 'digest' before opening the document."));
+		return(-1);
+	}
+	if(page == 0) {
+		if(psdoc->docdigestsize == 0) {
+			ps_error(psdoc, PS_RuntimeError, _("Checksum of the document is not available before PS_close() has been called."));
+			return(-1);
+		}
+		memcpy(digest, psdoc->docdigest, psdoc->docdigestsize);
+		return(psdoc->docdigestsize);
+	}
+	if(page < 0 || page > (int) psdoc->page || page > psdoc->pagestatssize || NULL == psdoc->pagedigests ||
+	   (page == (int) psdoc->page && psdoc->pagedigestopen)) {
+		ps_error(psdoc, PS_Warning, _("Checksum of page %d is not available."), page);
+		return(-1);
+	}
+	size = (psdoc->digesttype == PS_DIGEST_CRC32) ? 4 : 32;
+	memcpy(digest, &(psdoc->pagedigests[(page-1) * PS_DIGEST_MAXSIZE]), size);
+	return(size);
+}
+/* }}} */
+
 /* PS_set_border_style() {{{
  * Sets style of border for link destination
  */
@@ -6157,6 +7702,7 @@ PS_set_border_style(PSDoc *psdoc, const char *style, float width) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_DOCUMENT|PS_SCOPE_PAGE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'document' or 'page' scope."), __FUNCTION__);
 		return;
@@ -6182,6 +7728,7 @@ PS_set_border_color(PSDoc *psdoc, float red, float green, float blue) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_DOCUMENT|PS_SCOPE_PAGE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'document' or 'page' scope."), __FUNCTION__);
 		return;
@@ -6202,6 +7749,7 @@ PS_set_border_dash(PSDoc *psdoc, float black, float white) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_DOCUMENT|PS_SCOPE_PAGE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'document' or 'page' scope."), __FUNCTION__);
 		return;
@@ -6234,18 +7782,23 @@ _ps_output_anno_border(PSDoc *psdoc) {
  */
 PSLIB_API void PSLIB_CALL
 PS_add_weblink(PSDoc *psdoc, float llx, float lly, float urx, float ury, const char *url) {
+	int category;
+
 	if(NULL == psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page' scope."), __FUNCTION__);
 		return;
 	}
 
+	category = ps_set_stats_category(psdoc, PS_STATS_OTHER);
 	ps_printf(psdoc, "[ /Rect [ %f %f %f %f] ", llx, lly, urx, ury);
 	_ps_output_anno_border(psdoc);
 	ps_printf(psdoc, "/Action << /Subtype /URI /URI (%s) >> /Subtype /Link /ANN pdfmark\n", url);
+	ps_set_stats_category(psdoc, category);
 }
 /* }}} */
 
@@ -6254,15 +7807,19 @@ PS_add_weblink(PSDoc *psdoc, float llx, float lly, float urx, float ury, const c
  */
 PSLIB_API void PSLIB_CALL
 PS_add_pdflink(PSDoc *psdoc, float llx, float lly, float urx, float ury, const char *filename, int page, const char *dest) {
+	int category;
+
 	if(NULL == psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page' scope."), __FUNCTION__);
 		return;
 	}
 
+	category = ps_set_stats_category(psdoc, PS_STATS_OTHER);
 	ps_printf(psdoc, "[ /Rect [ %f %f %f %f] ", llx, lly, urx, ury);
 	_ps_output_anno_border(psdoc);
 	ps_printf(psdoc, "/Page %d ", page);
@@ -6277,6 +7834,7 @@ PS_add_pdflink(PSDoc *psdoc, float llx, float lly, float urx, float ury, const c
 	else if(0 != strcmp(dest, "retain"))
 		ps_error(psdoc, PS_RuntimeError, _("Parameter dest of PS_add_pdflink() must be 'fitpage', 'fitwidth', 'fitheight', 'fitbbox', 'retain'."));
 	ps_printf(psdoc, "/Action /GoToR /File (%s) /Subtype /Link /ANN pdfmark\n", filename);
+	ps_set_stats_category(psdoc, category);
 }
 /* }}} */
 
@@ -6285,15 +7843,19 @@ PS_add_pdflink(PSDoc *psdoc, float llx, float lly, float urx, float ury, const c
  */
 PSLIB_API void PSLIB_CALL
 PS_add_locallink(PSDoc *psdoc, float llx, float lly, float urx, float ury, const int page, const char *dest) {
+	int category;
+
 	if(NULL == psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page' scope."), __FUNCTION__);
 		return;
 	}
 
+	category = ps_set_stats_category(psdoc, PS_STATS_OTHER);
 	ps_printf(psdoc, "[ /Rect [ %f %f %f %f] ", llx, lly, urx, ury);
 	_ps_output_anno_border(psdoc);
 	if(page == PS_GOTO_NEXT_PAGE)
@@ -6313,6 +7875,7 @@ PS_add_locallink(PSDoc *psdoc, float llx, float lly, float urx, float ury, const
 	else if(0 != strcmp(dest, "retain"))
 		ps_error(psdoc, PS_RuntimeError, _("Parameter dest of PS_add_locallink() must be 'fitpage', 'fitwidth', 'fitheight', 'fitbbox', 'retain'."));
 	ps_printf(psdoc, "/Subtype /Link /ANN pdfmark\n");
+	ps_set_stats_category(psdoc, category);
 }
 /* }}} */
 
@@ -6321,18 +7884,23 @@ PS_add_locallink(PSDoc *psdoc, float llx, float lly, float urx, float ury, const
  */
 PSLIB_API void PSLIB_CALL
 PS_add_launchlink(PSDoc *psdoc, float llx, float lly, float urx, float ury, const char *filename) {
+	int category;
+
 	if(NULL == psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page' scope."), __FUNCTION__);
 		return;
 	}
 
+	category = ps_set_stats_category(psdoc, PS_STATS_OTHER);
 	ps_printf(psdoc, "[ /Rect [ %f %f %f %f] ", llx, lly, urx, ury);
 	_ps_output_anno_border(psdoc);
 	ps_printf(psdoc, "/Action << /S /Launch /F (%s) >> /Subtype /Link /ANN pdfmark\n", filename);
+	ps_set_stats_category(psdoc, category);
 }
 /* }}} */
 
@@ -6348,6 +7916,7 @@ PS_add_bookmark(PSDoc *psdoc, const char *text, int parent, int open) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return(0);
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page' scope."), __FUNCTION__);
 		return(0);
@@ -6400,15 +7969,19 @@ PS_add_bookmark(PSDoc *psdoc, const char *text, int parent, int open) {
  */
 PSLIB_API void PSLIB_CALL
 PS_add_note(PSDoc *psdoc, float llx, float lly, float urx, float ury, const char *contents, const char *title, const char *icon, int open) {
+	int category;
+
 	if(NULL == psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page' scope."), __FUNCTION__);
 		return;
 	}
 
+	category = ps_set_stats_category(psdoc, PS_STATS_OTHER);
 	ps_printf(psdoc, "[ /Rect [ %f %f %f %f] ", llx, lly, urx, ury);
 	_ps_output_anno_border(psdoc);
 	if(open)
@@ -6428,6 +8001,7 @@ PS_add_note(PSDoc *psdoc, float llx, float lly, float urx, float ury, const char
 	else if(0 == strcmp(icon, "help"))
 		ps_printf(psdoc, "/Name /Help ");
 	ps_printf(psdoc, "/Title (%s) /Contents (%s) /ANN pdfmark\n", title,  contents);
+	ps_set_stats_category(psdoc, category);
 }
 /* }}} */
 
@@ -6482,11 +8056,13 @@ PS_symbol(PSDoc *psdoc, unsigned char c) {
 	char text[2];
 	ENCODING *fontenc;
 	ADOBEINFO *ai;
+	int category;
 
 	if(NULL == psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page' scope."), __FUNCTION__);
 		return;
@@ -6500,8 +8076,10 @@ PS_symbol(PSDoc *psdoc, unsigned char c) {
 	if(ai) {
 		text[0] = c;
 		text[1] = '\0';
+		category = ps_set_stats_category(psdoc, PS_STATS_TEXT);
 		ps_printf(psdoc, "%.2f %.2f a\n", psdoc->tstates[psdoc->tstate].tx, psdoc->tstates[psdoc->tstate].ty);
 		ps_render_text(psdoc, text);
+		ps_set_stats_category(psdoc, category);
 		psdoc->tstates[psdoc->tstate].tx += ai->width*psdoc->font->size/1000.0;
 	}
 	ps_free_enc_vector(psdoc, fontenc);
@@ -6515,19 +8093,23 @@ PS_symbol(PSDoc *psdoc, unsigned char c) {
 PSLIB_API void PSLIB_CALL
 PS_glyph_show(PSDoc *psdoc, const char *name) {
 	ADOBEINFO *ai;
+	int category;
 
 	if(NULL == psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return;
 	}
+
 	if(!ps_check_scope(psdoc, PS_SCOPE_PAGE)) {
 		ps_error(psdoc, PS_RuntimeError, _("%s must be called within 'page' scope."), __FUNCTION__);
 		return;
 	}
 	ai = gfindadobe(psdoc->font->metrics->gadobechars, name);
 	if(ai) {
+		category = ps_set_stats_category(psdoc, PS_STATS_TEXT);
 		ps_printf(psdoc, "%.2f %.2f a\n", psdoc->tstates[psdoc->tstate].tx, psdoc->tstates[psdoc->tstate].ty);
 		ps_printf(psdoc, "/%s glyphshow\n", name);
+		ps_set_stats_category(psdoc, category);
 		psdoc->tstates[psdoc->tstate].tx += ai->width*psdoc->font->size/1000.0;
 	} else {
 		ps_error(psdoc, PS_RuntimeError, _("glyph '%s' is not available in current font."), __FUNCTION__);
@@ -6748,14 +8330,15 @@ PS_symbol_name(PSDoc *psdoc, unsigned char c, int fontid, char *name, int size)
  */
 PSLIB_API int PSLIB_CALL
 PS_include_file(PSDoc *psdoc, const char *filename) {
-	unsigned char *bb;
 	FILE *fp;
 	long fsize;
+	int ret = 0, category;
 
 	if(NULL == psdoc) {
 		ps_error(psdoc, PS_RuntimeError, _("PSDoc is null."));
 		return -1;
 	}
+
 	/* If the header is not written, because we are before
 	 * the first page, then output the header first.
 	 */
@@ -6786,18 +8369,18 @@ PS_include_file(PSDoc *psdoc, const char *filename) {
 		return 0;
 	}
 	fseek(fp, 0, SEEK_SET);
-	if(NULL != (bb = malloc(fsize))) {
-		fread(bb, fsize, 1, fp);
-		ps_printf(psdoc, "PslibDict begin\n");
-		ps_write(psdoc, bb, fsize);
-		ps_printf(psdoc, "end\n");
-		free(bb);
-	} else {
-		ps_error(psdoc, PS_MemoryError, _("Could not allocate memory for include file '%s'"), filename);
-		return -1;
+	category = ps_set_stats_category(psdoc, PS_STATS_PROLOG);
+	ps_printf(psdoc, "PslibDict begin\n");
+	/* The dictionary is closed in any case to keep the document
+	 * balanced */
+	if(ps_write_file(psdoc, fp, fsize) < fsize) {
+		ps_error(psdoc, PS_IOError, _("Could not read include file '%s' completely."), filename);
+		ret = -1;
 	}
+	ps_printf(psdoc, "end\n");
+	ps_set_stats_category(psdoc, category);
 	fclose(fp);
-	return 0;
+	return ret;
 }
 /* }}} */
 
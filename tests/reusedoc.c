@@ -0,0 +1,127 @@
+/*
+ *    (c) Copyright 2026  Uwe Steinmann.
+ *    All rights reserved.
+ *
+ *    This library is free software; you can redistribute it and/or
+ *    modify it under the terms of the GNU Lesser General Public
+ *    License as published by the Free Software Foundation; either
+ *    version 2 of the License, or (at your option) any later version.
+ *
+ *    This library is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ *    Lesser General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Lesser General Public
+ *    License along with this library; if not, write to the
+ *    Free Software Foundation, Inc., 59 Temple Place - Suite 330,
+ *    Boston, MA 02111-1307, USA.
+ */
+
+/* Writes several documents with the same PSDoc and checks that the
+ * statistics, the index and the checksums of each document refer to
+ * that document only. The second document also turns on checksums
+ * which were off for the first one.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <libps/pslib.h>
+
+#define NUMPAGES 3
+
+static char *buffer = NULL;
+static size_t buflen = 0;
+static size_t bufsize = 0;
+static int failures = 0;
+
+static size_t
+writeproc(PSDoc *p, void *data, size_t size) {
+	(void) p;
+	if(buflen + size > bufsize) {
+		bufsize = 2 * (buflen + size);
+		if(NULL == (buffer = realloc(buffer, bufsize))) {
+			fprintf(stderr, "Could not allocate memory.\n");
+			exit(1);
+		}
+	}
+	memcpy(buffer + buflen, data, size);
+	buflen += size;
+	return(size);
+}
+
+static void
+check(int doc, int ok, const char *what) {
+	if(!ok) {
+		fprintf(stderr, "document %d: %s\n", doc, what);
+		failures++;
+	}
+}
+
+/* Checks that the text at pos in the output starts with str */
+static int
+at(unsigned long long pos, const char *str) {
+	return(pos + strlen(str) <= buflen && 0 == strncmp(buffer + pos, str, strlen(str)));
+}
+
+static void
+write_document(PSDoc *ps, int doc) {
+	PSStats stats;
+	PSPageStats pagestats;
+	PSDocIndex index;
+	unsigned char digest[PS_DIGEST_MAXSIZE];
+	char pagecomment[32];
+	int i;
+
+	buflen = 0;
+	PS_open_mem(ps, writeproc);
+	for(i = 1; i <= NUMPAGES; i++) {
+		PS_begin_page(ps, 596, 842);
+		PS_moveto(ps, 100, 100);
+		PS_lineto(ps, 200, 100 + 50 * i);
+		PS_stroke(ps);
+		PS_end_page(ps);
+	}
+	PS_close(ps);
+
+	PS_get_stats(ps, &stats);
+	check(doc, stats.size == buflen, "size in statistics differs from the output");
+	check(doc, stats.pages == NUMPAGES, "wrong number of pages in statistics");
+
+	PS_get_index(ps, &index);
+	check(doc, index.size == buflen, "size in index differs from the output");
+	check(doc, at(index.trailer, "%%Trailer"), "trailer is not at its position in the index");
+	check(doc, index.prolog == 0 || at(index.prolog, "%%BeginProlog"), "prolog is not at its position in the index");
+
+	for(i = 1; i <= NUMPAGES; i++) {
+		if(0 != PS_get_page_stats(ps, i, &pagestats)) {
+			check(doc, 0, "page statistics are missing");
+			continue;
+		}
+		sprintf(pagecomment, "%%%%Page: %d %d", i, i);
+		check(doc, at(pagestats.offset, pagecomment), "page is not at its position in the page statistics");
+		if(doc > 1)
+			check(doc, PS_get_digest(ps, i, digest) > 0, "checksum of page is missing");
+	}
+	if(doc > 1)
+		check(doc, PS_get_digest(ps, 0, digest) > 0, "checksum of document is missing");
+}
+
+int main(void) {
+	PSDoc *ps;
+	int doc;
+
+	PS_boot();
+	ps = PS_new();
+	for(doc = 1; doc <= 3; doc++) {
+		if(doc == 2)
+			PS_set_parameter(ps, "digest", "sha256");
+		write_document(ps, doc);
+	}
+	PS_delete(ps);
+	PS_shutdown();
+	free(buffer);
+
+	return(failures ? 1 : 0);
+}